@@ -5,6 +5,21 @@
 #define WIFI_SSID "YOUR_SSID"
 #define WIFI_PASS "YOUR_PASSWORD"
 
+// Fast reconnect: the AP's BSSID and channel are cached in NVS after
+// each successful association and passed to WiFi.begin() on the next
+// boot, skipping the 3-8 s full scan — a warm boot associates in a
+// few hundred ms. If the cached AP is gone the attempt times out
+// after this many milliseconds and falls back to a full scan (which
+// refreshes the cache).
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+
+// Optional static IP, skipping DHCP on boot as well. Leave
+// USE_STATIC_IP at 0 for DHCP.
+#define USE_STATIC_IP 0
+#define STATIC_IP      "192.168.1.60"
+#define STATIC_GATEWAY "192.168.1.1"
+#define STATIC_SUBNET  "255.255.255.0"
+
 // Camera Model Pinout (AI-Thinker ESP32-CAM)
 #define PWDN_GPIO_NUM     32
 #define RESET_GPIO_NUM    -1
@@ -24,9 +39,269 @@
 #define HREF_GPIO_NUM     23
 #define PCLK_GPIO_NUM     22
 
+// Detection-event uplink: push fixed-size binary event records
+// (timestamp, score, box) to an espcomms hub over its TCP
+// binary-framing protocol, batched and rate-limited. Fleet alerting
+// then costs tens of bytes per event instead of a server-side decode
+// of the MJPEG stream.
+#ifndef DETECTION_UPLINK
+#define DETECTION_UPLINK 1
+#endif
+
+// The hub to publish to (the espcomms SoftAP address and TCP port)
+#define UPLINK_HOST "192.168.4.1"
+#define UPLINK_PORT 8080
+
+// Broker topic the event records publish to
+#define UPLINK_TOPIC 7
+
+// Hub protocol constants — must match espcomms include/config.h
+#define HUB_FRAMING_MAGIC_0 0xA5
+#define HUB_FRAMING_MAGIC_1 0x5A
+#define HUB_FRAMING_MAGIC_2 'B'
+#define HUB_FRAMING_MAGIC_3 'F'
+#define HUB_OP_PUBLISH 0x03
+
+// Rate limit: minimum gap between recorded events, so a cat sitting
+// in frame is one event per interval, not one per inference
+#define UPLINK_MIN_EVENT_GAP_MS 1000
+
+// Batch window: after the first queued event, wait this long and send
+// everything that accumulated as one frame
+#define UPLINK_FLUSH_MS 500
+
+// Pending events held while the hub is unreachable
+#define UPLINK_QUEUE_DEPTH 8
+
+// Backoff between reconnect attempts
+#define UPLINK_RECONNECT_MS 5000
+
+#define UPLINK_TASK_CORE       0
+#define UPLINK_TASK_PRIORITY   1 // Below capture and the HTTP server
+#define UPLINK_TASK_STACK_SIZE 4096
+
+// Model loading. With MODEL_FROM_PARTITION set the model is
+// memory-mapped straight out of the 'model' flash partition (see
+// partitions_model.csv) and the mapped pointer handed to the
+// interpreter: the model updates independently of the firmware with a
+// single esptool write, the app binary shrinks by the model size, and
+// boot copies no model bytes at all. Flash a converted model with:
+//   esptool.py write_flash 0x2F0000 model.tflite
+// Falls back to the embedded model_data.h array when the partition is
+// missing or does not hold a TFLite flatbuffer.
+#ifndef MODEL_FROM_PARTITION
+#define MODEL_FROM_PARTITION 1
+#endif
+#define MODEL_PARTITION_LABEL "model"
+
+// Multi-model slot engine. The 'model' partition is divided into
+// MODEL_SLOT_COUNT fixed sub-slots of MODEL_SLOT_SIZE; every sub-slot
+// holding a TFLite flatbuffer is registered at boot, and the inference
+// task time-slices inference cycles across the loaded slots in a
+// weighted round-robin. All resident models share the one tensor arena
+// (sized for the largest of them) — switching slots re-plans the arena
+// for the next flash-mapped graph instead of keeping one arena per
+// model, so N classifiers cost roughly the memory of one. Slot 0 is
+// the alert model; later slots are rejection models flashed per site
+// (see partitions_model.csv for the slot offsets).
+#ifndef MULTI_MODEL
+#define MULTI_MODEL 1
+#endif
+#define MODEL_SLOT_COUNT 4
+#define MODEL_SLOT_SIZE (256 * 1024)
+
+// Consecutive rotation turns the alert slot takes before the rejection
+// slots get one each, so the primary detector keeps most of the
+// inference rate
+#define MODEL_PRIMARY_WEIGHT 2
+
+// A valid detection from a rejection slot vetoes alert-slot uplink
+// events for this long — the hub stays quiet while a raccoon or a
+// person is the likely subject
+#define REJECT_HOLDOFF_MS 5000
+
 // Model Configuration
+// The model takes a 96x96 RGB image and returns 6 floats:
+// [not_cat, cat, x_min, y_min, x_max, y_max] with the box normalized
+// to 0..1 of the input image.
 #define DETECTION_THRESHOLD 0.6
+
+// Run the model on every Nth captured frame; the stream overlays the
+// most recent cached detection in between. Cats do not move at 25 FPS,
+// so 2-3 Hz inference keeps the video at sensor rate.
+#define INFERENCE_FRAME_INTERVAL 8
 #define INPUT_WIDTH  96
 #define INPUT_HEIGHT 96
+#define MODEL_INPUT_LEN  (INPUT_WIDTH * INPUT_HEIGHT * 3)
+#define MODEL_OUTPUT_LEN 6
+
+// On-device benchmark (built by the esp32cam_bench environment).
+// BENCH_MODE replaces the normal firmware with a boot-time scripted
+// run of each pipeline stage in isolation, reporting mean/p95/max per
+// stage as machine-parseable CAMBENCH serial lines.
+#ifndef BENCH_MODE
+#define BENCH_MODE 0
+#endif
+
+// Iterations per stage of the scripted benchmark
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 50
+#endif
+
+// Latency instrumentation: each pipeline stage is timed with the CPU
+// cycle counter and bucketed into a fixed histogram; /stats on the
+// camera server returns the aggregates as JSON. A record costs a
+// cycle-counter read and one increment, so it stays on in production.
+#define STATS_HIST_BUCKETS 8
+#define STATS_CYCLES_PER_US 240 // 240 MHz core clock
+
+// Motion gate: before running the model, compare a coarse 32x24 luma
+// grid of the candidate frame against the previous one, blockwise
+// (8x8-cell blocks). Inference (and the RGB conversion feeding it) is
+// skipped unless at least MOTION_MIN_BLOCKS blocks changed by more
+// than MOTION_BLOCK_THRESHOLD mean absolute luma. Costs ~2 ms against
+// tens of ms of inference on a porch that is empty 95% of the day.
+// (overridable from build flags for A/B benchmarking)
+#ifndef MOTION_GATE
+#define MOTION_GATE 1
+#endif
+#define MOTION_GRID_W 32
+#define MOTION_GRID_H 24
+#define MOTION_BLOCK_THRESHOLD 12 // Mean abs luma delta per block, 0-255
+#define MOTION_MIN_BLOCKS 2
+
+// Quantized inference: build for a fully int8-quantized model. The
+// preprocessing kernel writes int8 pixels straight into the input
+// tensor (no 108 KB float staging, no float ops in the model), and
+// outputs are dequantized with the parameters below, which come from
+// the converter's report for the shipped model.
+// (overridable from build flags for A/B benchmarking)
+#ifndef QUANTIZED_MODEL
+#define QUANTIZED_MODEL 1
+#endif
+
+// Input quantization: real = (q - zero_point) * scale. The standard
+// uint8-image conversion gives scale 1/255, zero point -128.
+#define MODEL_INPUT_ZERO_POINT (-128)
+
+// Output quantization from the converted model
+#define MODEL_OUTPUT_SCALE      0.00390625f // 1/256
+#define MODEL_OUTPUT_ZERO_POINT (-128)
+
+// Tensor arena sizing. The int8 model's requirement was measured with
+// the interpreter's arena_used_bytes() after allocation, plus ~10%
+// headroom; the float build keeps the larger arena it needs. With
+// MULTI_MODEL the single arena is shared by every resident model, so
+// it must cover the largest of them.
+#if QUANTIZED_MODEL
+#define TENSOR_ARENA_SIZE (40 * 1024)
+#else
+#define TENSOR_ARENA_SIZE (60 * 1024)
+#endif
+
+// Low-latency capture: triple-buffer the sensor and grab the latest
+// frame instead of the oldest queued one. With two buffers and
+// CAMERA_GRAB_WHEN_EMPTY, fb_get() hands out frames queued while the
+// pipeline was busy, so the live view lags reality by several frame
+// times; CAMERA_GRAB_LATEST lets the driver overwrite stale frames
+// and bounds glass-to-stream latency at about one frame time, at the
+// cost of one more PSRAM frame buffer. Frames the driver skipped past
+// show up as sensor-timestamp gaps and are counted in /stats.
+#ifndef LOW_LATENCY_CAPTURE
+#define LOW_LATENCY_CAPTURE 1
+#endif
+
+#if LOW_LATENCY_CAPTURE
+#define CAPTURE_FB_COUNT 3
+#define CAPTURE_GRAB_MODE CAMERA_GRAB_LATEST
+#else
+#define CAPTURE_FB_COUNT 2
+#define CAPTURE_GRAB_MODE CAMERA_GRAB_WHEN_EMPTY
+#endif
+
+// Pipeline Configuration
+// Capture + JPEG encode run in one task, inference in another, with
+// queue handoffs between the stages. Inference gets the app core to
+// itself; capture/encode share core 0 with WiFi and the HTTP server,
+// whose work is mostly waiting on the camera driver and the socket.
+#define CAPTURE_TASK_CORE       0
+#define CAPTURE_TASK_PRIORITY   3
+#define CAPTURE_TASK_STACK_SIZE 8192
+
+#define INFER_TASK_CORE       1
+#define INFER_TASK_PRIORITY   3
+#define INFER_TASK_STACK_SIZE 8192
+
+// Concurrent stream viewers. Each connected viewer gets its own
+// sender task and frame-available wakeup slot; connections beyond
+// this are refused with a 503.
+#define MAX_STREAM_CLIENTS 4
+
+// Per-viewer sender tasks, created by the /stream handler when the
+// socket is detached from the HTTP server task. Below capture so a
+// slow viewer cannot hold off the pipeline.
+#define STREAM_TASK_CORE       0
+#define STREAM_TASK_PRIORITY   2
+#define STREAM_TASK_STACK_SIZE 4096
+
+// Encoded-frame broadcaster: the pipeline publishes each JPEG once and
+// every connected stream client sends from the same shared buffer.
+// FRAME_POOL_SIZE bounds how many frames can be alive at once (the
+// current one plus frames still being sent to slow clients).
+#define FRAME_POOL_SIZE 4
+
+// Size of each fixed PSRAM JPEG buffer backing the stream. One buffer
+// per frame-pool slot is allocated once at boot and reused forever, so
+// the steady-state stream performs zero heap allocations. QVGA JPEG
+// frames run 10-30 KB; 48 KB leaves margin for noisy scenes.
+#define STREAM_JPEG_BUF_SIZE (48 * 1024)
+
+// JPEG quality for stream re-encoding of RGB565 frames
+#define JPEG_STREAM_QUALITY 80
+
+// Adaptive stream quality: a feedback controller watches per-frame
+// send time and frame-pool drops and steps the stream down (coarser
+// JPEG first, then a smaller frame) when a viewer's socket backs up,
+// then back up once things stay healthy. Frames are encoded once and
+// broadcast, so the controller is global and follows the slowest
+// connected viewer rather than stalling the pipeline behind it.
+#ifndef ADAPTIVE_STREAM
+#define ADAPTIVE_STREAM 1
+#endif
+
+// Controller evaluation period
+#define ADAPT_INTERVAL_MS 1000
+
+// Worst per-frame send time still considered healthy. QVGA frames at
+// 25 FPS leave a 40 ms frame budget; past twice that the viewer is
+// visibly behind.
+#define ADAPT_SEND_BUDGET_US 80000
+
+// Healthy periods required before stepping quality back up
+#define ADAPT_HOLD_PERIODS 5
+
+// Overlay compositor scratch sizing (frame dimensions the save strip
+// must cover; QVGA). The strip holds the pixels under the box edges —
+// two full-width rows plus two pixels per interior row — so it stays
+// in internal RAM.
+#define OVERLAY_MAX_WIDTH  320
+#define OVERLAY_MAX_HEIGHT 240
+
+// Native JPEG streaming: capture PIXFORMAT_JPEG straight from the
+// OV2640's hardware encoder and send sensor frames with zero
+// conversion, decoding to RGB only for the frames actually fed to the
+// model. Removes the ~150 ms software fmt2jpg from every streamed
+// frame. Trade-off: the box overlay needs writable RGB frames, so it
+// is unavailable in this mode — detections still run and are reported.
+// Set to 0 to return to RGB565 capture with overlay and software
+// encode.
+// (overridable from build flags for A/B benchmarking)
+#ifndef NATIVE_JPEG_STREAM
+#define NATIVE_JPEG_STREAM 1
+#endif
+
+// Quality requested from the sensor's hardware encoder (0-63, lower
+// is better)
+#define JPEG_SENSOR_QUALITY 12
 
 #endif
\ No newline at end of file
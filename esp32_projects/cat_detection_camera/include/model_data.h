@@ -7,6 +7,11 @@
  *    xxd -i model.tflite > model_data.h
  * 3. Paste the content of the generated array below.
  * 4. Ensure the array is named 'model'.
+ *
+ * With MODEL_FROM_PARTITION set (the default) this array is only the
+ * fallback for boards whose 'model' flash partition is empty; flash
+ * the .tflite file to the partition instead (see partitions_model.csv)
+ * and leave this placeholder as is.
  */
 
 #ifndef MODEL_DATA_H
@@ -1,59 +1,855 @@
 /**
  * Cat Detection Camera - ESP32-CAM
- * 
+ *
  * Features:
  * - MobileNetV2-SSD Object Detection
  * - Real-time bounding box overlay
  * - MJPEG Web Streaming
  * - PSRAM enabled
+ *
+ * The per-frame work is pipelined across both cores: a capture/encode
+ * task owns the camera and the JPEG conversion, the inference task owns
+ * the model on the other core, and the HTTP stream handler just sends
+ * whatever the encoder queues. Inference only borrows a frame for the
+ * few milliseconds it takes to copy the input tensor out, so encode of
+ * frame N overlaps with the model running on frame N.
  */
 
 #include <Arduino.h>
 #include <WiFi.h>
+#include <Preferences.h>
 #include <esp_camera.h>
 #include <esp_http_server.h>
+#include <esp_partition.h>
 #include <fb_gfx.h>
-#include <EloquentTinyML.h>
+#include <new>
+#include <TensorFlowLite_ESP32.h>
+#include "tensorflow/lite/micro/all_ops_resolver.h"
+#include "tensorflow/lite/micro/micro_error_reporter.h"
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "hp_pool.h"
+#include "hp_frame.h"
 #include "model_data.h"
 #include "config.h"
 
-// TensorFlow Lite Settings
-#define TENSOR_ARENA_SIZE 60 * 1024 // Adjust based on model size
-Eloquent::TinyML::TfLite<96, 96, 2, TENSOR_ARENA_SIZE> ml;
+// TensorFlow Lite Micro runner. Drives MicroInterpreter directly:
+// the quantized kernel writes into the raw int8 input tensor, and the
+// model slot engine re-initializes on a different flash-mapped graph
+// per switch — neither of which the EloquentTinyML facade exposes.
+// begin() placement-news the interpreter over static storage, so every
+// call re-plans the one shared tensor arena (sized in config.h) for
+// the given graph.
+class ModelRunner {
+public:
+  // (Re)initialize on a flatbuffer graph. Safe to call repeatedly; the
+  // previous interpreter is torn down first.
+  bool begin(const unsigned char *graph) {
+    const tflite::Model *m = tflite::GetModel(graph);
+    if (m->version() != TFLITE_SCHEMA_VERSION) {
+      Serial.printf("Model schema version %lu, expected %d\n",
+                    (unsigned long)m->version(), TFLITE_SCHEMA_VERSION);
+      return false;
+    }
+    end();
+    interpreter = new (interpreter_mem)
+        tflite::MicroInterpreter(m, resolver, arena, TENSOR_ARENA_SIZE,
+                                 &error_reporter);
+    if (interpreter->AllocateTensors() != kTfLiteOk) {
+      Serial.println("Tensor arena allocation failed");
+      end();
+      return false;
+    }
+    return true;
+  }
+
+  bool invoke() {
+    return interpreter != NULL && interpreter->Invoke() == kTfLiteOk;
+  }
+
+#if QUANTIZED_MODEL
+  int8_t *getQuantizedInputTensor() { return interpreter->input(0)->data.int8; }
+  int8_t *getQuantizedOutputTensor() { return interpreter->output(0)->data.int8; }
+#else
+  float *getInputTensor() { return interpreter->input(0)->data.f; }
+  float *getOutputTensor() { return interpreter->output(0)->data.f; }
+#endif
+
+private:
+  void end() {
+    if (interpreter != NULL) {
+      interpreter->~MicroInterpreter();
+      interpreter = NULL;
+    }
+  }
+
+  tflite::MicroErrorReporter error_reporter;
+  tflite::AllOpsResolver resolver;
+  alignas(16) uint8_t arena[TENSOR_ARENA_SIZE];
+  alignas(alignof(tflite::MicroInterpreter))
+      uint8_t interpreter_mem[sizeof(tflite::MicroInterpreter)];
+  tflite::MicroInterpreter *interpreter = NULL;
+};
+
+ModelRunner ml;
 
 // Global variables
-camera_fb_t *fb = NULL;
 bool camera_initialized = false;
 
-// Define the model
-const unsigned char model[] = {
-  #include "model_data.h"
+// MJPEG stream framing
+#define _STREAM_CONTENT_TYPE "multipart/x-mixed-replace;boundary=frame"
+#define _STREAM_BOUNDARY "\r\n--frame\r\n"
+#define _STREAM_PART "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n"
+
+// Result of one inference pass
+struct Detection {
+  bool valid;     // Score cleared DETECTION_THRESHOLD
+  float score;    // Cat-class confidence 0..1
+  float box[4];   // x_min, y_min, x_max, y_max, normalized 0..1
+};
+
+#if QUANTIZED_MODEL
+// The kernel writes int8 pixels straight into the interpreter's input
+// tensor; no staging buffers exist in the quantized build.
+#else
+// The float build stages nothing either: the kernel writes normalized
+// floats straight into the interpreter's input tensor via this LUT
+// (uint8 channel value -> v / 255), so no per-pixel float math happens
+// and no 135 KB of .bss staging competes with the tensor arena for
+// DRAM.
+static float pixel_norm_lut[256];
+#endif
+
+// One JPEG-encoded frame, published once by the pipeline and sent by
+// every connected stream client from the same buffer. refs counts
+// clients mid-send; a frame's buffer is freed once it is no longer
+// current and no client holds it.
+struct SharedFrame {
+  uint8_t *buf;
+  size_t len;
+  uint32_t seq;     // Monotonic publish counter
+  int refs;         // Clients currently sending this frame
+  bool in_use;      // Pool slot occupied
+};
+
+// Static pool of frame descriptors and the broadcaster state
+static SharedFrame frame_pool[FRAME_POOL_SIZE];
+static SharedFrame *current_frame = NULL;
+static uint32_t publish_seq = 0;
+static uint32_t frames_dropped_no_slot = 0;
+static portMUX_TYPE frame_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Frame-available wakeups. Each stream client claims a slot holding a
+// binary semaphore that publish_frame gives on every publish, so a
+// waiting sender wakes the moment a new frame exists instead of
+// polling on a one-tick delay.
+static SemaphoreHandle_t frame_waiters[MAX_STREAM_CLIENTS];
+static volatile bool frame_waiter_claimed[MAX_STREAM_CLIENTS];
+
+// Per-viewer sender state. httpd runs every URI handler on its one
+// server task, so an in-handler send loop would serve a single viewer
+// and starve every other request; instead the /stream handler detaches
+// the socket, hands it to a dedicated sender task, and returns
+// immediately. The slot index doubles as the frame-waiter index above.
+struct StreamClient {
+  httpd_handle_t hd;
+  int fd;
+};
+static StreamClient stream_clients[MAX_STREAM_CLIENTS];
+
+// Claim a sender slot for a stream connection. Returns -1 when every
+// slot is taken; the connection is then refused.
+static int waiter_claim() {
+  int slot = -1;
+  taskENTER_CRITICAL(&frame_mux);
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    if (!frame_waiter_claimed[i]) {
+      frame_waiter_claimed[i] = true;
+      slot = i;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&frame_mux);
+  return slot;
+}
+
+static void waiter_release(int slot) {
+  if (slot >= 0) {
+    frame_waiter_claimed[slot] = false;
+  }
+}
+
+// PSRAM JPEG arena: one fixed buffer per frame-pool slot, allocated
+// once at boot and recycled across frames, managed by the shared
+// hotpath block pool (esp32_projects/common/hotpath). Replaces the
+// per-frame malloc/free pair that fragmented the heap until large
+// allocations failed in the field.
+static uint8_t *jpeg_arena[FRAME_POOL_SIZE];
+static bool jpeg_arena_busy[FRAME_POOL_SIZE];
+static BlockPool jpeg_pool;
+static uint32_t arena_frame_len_hw = 0;    // Largest JPEG seen
+static uint32_t arena_oversize = 0;        // Frames dropped, larger than a buffer
+
+// Grab a free arena buffer, or NULL when every buffer is still held
+uint8_t *arena_acquire() {
+  return poolAcquire(jpeg_pool);
+}
+
+#if !NATIVE_JPEG_STREAM
+// Encoder output context for fmt2jpg_cb: fills an arena buffer and
+// flags overflow instead of growing anything
+struct JpgEncodeCtx {
+  uint8_t *buf;
+  size_t len;
+  bool overflow;
+};
+
+static size_t jpg_arena_write_cb(void *arg, size_t index, const void *data, size_t len) {
+  JpgEncodeCtx *ctx = (JpgEncodeCtx *)arg;
+  if (index + len > STREAM_JPEG_BUF_SIZE) {
+    ctx->overflow = true;
+    return 0;
+  }
+  memcpy(ctx->buf + index, data, len);
+  if (index + len > ctx->len) {
+    ctx->len = index + len;
+  }
+  return len;
+}
+#endif
+
+// Return a buffer to the arena
+void arena_release(uint8_t *buf) {
+  poolRelease(jpeg_pool, buf);
+}
+
+// Pipeline stages tracked by the latency instrumentation
+enum StatsStage {
+  STAGE_CAPTURE = 0, // esp_camera_fb_get wait
+  STAGE_INFER,       // gate + decode + preprocess + predict
+  STAGE_ENCODE,      // JPEG encode / arena copy
+  STAGE_SEND,        // httpd_resp_send_chunk set per frame
+  STAGE_COUNT
+};
+
+static const char *stage_names[STAGE_COUNT] = {
+  "capture", "infer", "encode", "send"
+};
+
+// Per-stage aggregates. Capture, infer and encode each have a single
+// writer task, so their updates stay lock-free aligned stores; the
+// send stage is written by up to MAX_STREAM_CLIENTS sender tasks at
+// once and takes a spinlock around its read-modify-writes (count, the
+// 64-bit sum and the histogram would otherwise lose increments and
+// tear). Cheap enough to leave on permanently either way.
+struct StageStats {
+  volatile uint32_t count;
+  volatile uint64_t sum_us;
+  volatile uint32_t max_us;
+  volatile uint32_t hist[STATS_HIST_BUCKETS];
+};
+
+static StageStats stage_stats[STAGE_COUNT];
+static portMUX_TYPE stats_send_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint32_t stats_hist_bounds_us[STATS_HIST_BUCKETS - 1] = {
+  250, 500, 1000, 2500, 5000, 10000, 25000
+};
+
+// Cycle-counter timestamp; wraps every ~18 s at 240 MHz, which is fine
+// for stage-scale durations
+static inline uint32_t stats_now() {
+  return esp_cpu_get_ccount();
+}
+
+// Record one stage duration from a pair of stats_now() readings
+static inline void stats_record(StatsStage stage, uint32_t start_cycles) {
+  uint32_t us = (stats_now() - start_cycles) / STATS_CYCLES_PER_US;
+  StageStats &s = stage_stats[stage];
+
+  int b = 0;
+  while (b < STATS_HIST_BUCKETS - 1 && us >= stats_hist_bounds_us[b]) {
+    b++;
+  }
+
+  bool multi_writer = (stage == STAGE_SEND);
+  if (multi_writer) {
+    taskENTER_CRITICAL(&stats_send_mux);
+  }
+  s.count = s.count + 1;
+  s.sum_us = s.sum_us + us;
+  if (us > s.max_us) {
+    s.max_us = us;
+  }
+  s.hist[b] = s.hist[b] + 1;
+  if (multi_writer) {
+    taskEXIT_CRITICAL(&stats_send_mux);
+  }
+}
+
+#if ADAPTIVE_STREAM
+// Adaptive stream quality controller. The stream handler feeds it
+// per-frame send times; once per ADAPT_INTERVAL_MS it compares the
+// worst send of the period (and any frame-pool drops, which mean a
+// viewer is pinning buffers) against the budget and steps the level
+// table below. Downshifts are immediate; an upshift needs
+// ADAPT_HOLD_PERIODS consecutive healthy periods so the stream does
+// not oscillate on a marginal link. The capture task applies pending
+// sensor changes between frames, where the driver is quiescent.
+struct StreamLevel {
+  framesize_t frame_size;
+  int sensor_quality;   // OV2640 hardware encoder, 0-63 lower = better
+  int encode_quality;   // fmt2jpg software encoder, 0-100 higher = better
 };
 
+static const StreamLevel stream_levels[] = {
+  { FRAMESIZE_QVGA,  JPEG_SENSOR_QUALITY,      JPEG_STREAM_QUALITY      },
+  { FRAMESIZE_QVGA,  JPEG_SENSOR_QUALITY + 10, JPEG_STREAM_QUALITY - 20 },
+  { FRAMESIZE_QQVGA, JPEG_SENSOR_QUALITY + 10, JPEG_STREAM_QUALITY - 20 },
+};
+#define STREAM_LEVEL_COUNT ((int)(sizeof(stream_levels) / sizeof(stream_levels[0])))
+
+static volatile int stream_level = 0;         // Level applied to the sensor
+static volatile int stream_level_pending = 0; // Level requested by the controller
+static uint32_t adapt_send_us_max = 0;        // Worst send this period
+static uint32_t adapt_send_frames = 0;
+static uint32_t adapt_last_eval_ms = 0;
+static uint32_t adapt_last_drops = 0;
+static uint32_t adapt_healthy_periods = 0;
+static uint32_t adapt_downshifts = 0;
+static uint32_t adapt_upshifts = 0;
+static portMUX_TYPE adapt_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Feed one frame's send duration into the current period
+static void adapt_record_send(uint32_t send_us) {
+  taskENTER_CRITICAL(&adapt_mux);
+  if (send_us > adapt_send_us_max) {
+    adapt_send_us_max = send_us;
+  }
+  adapt_send_frames++;
+  taskEXIT_CRITICAL(&adapt_mux);
+}
+
+// Periodic evaluation, run from the sender tasks (no viewers means no
+// send pressure and nothing to adapt). The interval check sits inside
+// the critical section so concurrent senders cannot both claim the
+// same period.
+static void adapt_evaluate() {
+  uint32_t now = millis();
+
+  taskENTER_CRITICAL(&adapt_mux);
+  if (now - adapt_last_eval_ms < ADAPT_INTERVAL_MS) {
+    taskEXIT_CRITICAL(&adapt_mux);
+    return;
+  }
+  adapt_last_eval_ms = now;
+  uint32_t worst_us = adapt_send_us_max;
+  adapt_send_us_max = 0;
+  adapt_send_frames = 0;
+  taskEXIT_CRITICAL(&adapt_mux);
+
+  uint32_t drops = frames_dropped_no_slot - adapt_last_drops;
+  adapt_last_drops = frames_dropped_no_slot;
+
+  if (worst_us > ADAPT_SEND_BUDGET_US || drops > 0) {
+    adapt_healthy_periods = 0;
+    if (stream_level_pending < STREAM_LEVEL_COUNT - 1) {
+      stream_level_pending = stream_level_pending + 1;
+      adapt_downshifts++;
+    }
+  } else if (++adapt_healthy_periods >= ADAPT_HOLD_PERIODS) {
+    adapt_healthy_periods = 0;
+    if (stream_level_pending > 0) {
+      stream_level_pending = stream_level_pending - 1;
+      adapt_upshifts++;
+    }
+  }
+}
+#endif // ADAPTIVE_STREAM
+
+// Pipeline handoffs. infer_queue carries the frame pointer to the
+// inference task; infer_copied signals that the input tensor has been
+// copied out and the frame buffer is free to encode.
+static QueueHandle_t infer_queue = NULL;
+static SemaphoreHandle_t infer_copied = NULL;
+
+// Most recent completed detection, published by the inference task and
+// overlaid by the encode stage
+static Detection latest_detection = {};
+static portMUX_TYPE detection_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#if MULTI_MODEL
+// Model slot engine. Each loaded slot is one flash-mapped quantized
+// model; all of them share the single interpreter and tensor arena
+// above, and the inference task hands each inference cycle to the next
+// slot in a weighted rotation. Slot 0 is the alert model — only its
+// detections drive the overlay and the uplink. A rejection slot that
+// fires holds alert events back for REJECT_HOLDOFF_MS, so a raccoon on
+// the porch does not page anyone as a low-confidence cat.
+
+enum SlotKind { SLOT_ALERT, SLOT_REJECT };
+
+struct ModelSlot {
+  const char *name;
+  SlotKind kind;
+  uint8_t weight;              // Consecutive rotation turns
+  const unsigned char *graph;  // Flash-mapped flatbuffer, NULL if empty
+  uint32_t runs;
+  uint32_t hits;               // Detections above threshold
+};
+
+// Site convention for the partition sub-slots (partitions_model.csv
+// documents the flash offsets). Empty slots are skipped by the
+// scheduler, so a site that only flashed the cat model runs exactly
+// like the single-model firmware.
+static ModelSlot model_slots[MODEL_SLOT_COUNT] = {
+  { "cat",     SLOT_ALERT,  MODEL_PRIMARY_WEIGHT, NULL, 0, 0 },
+  { "raccoon", SLOT_REJECT, 1,                    NULL, 0, 0 },
+  { "person",  SLOT_REJECT, 1,                    NULL, 0, 0 },
+  { "aux",     SLOT_REJECT, 1,                    NULL, 0, 0 },
+};
+
+static int active_slot = -1;         // Slot the interpreter is begun on
+static int sched_slot = 0;           // Rotation position
+static uint8_t sched_turns = 0;      // Turns taken at that position
+static uint32_t model_switches = 0;  // Arena replans
+static uint32_t reject_until_ms = 0; // Alert veto deadline, 0 when clear
+static uint32_t reject_vetoes = 0;   // Alert events held back
+
+// True while a rejection slot's holdoff window is open
+static inline bool reject_veto_active() {
+  return reject_until_ms != 0 && (int32_t)(reject_until_ms - millis()) > 0;
+}
+
+// Probe the partition sub-slots and register every one holding a
+// TFLite flatbuffer ("TFL3" at offset 4). Slot 0 falls back to the
+// embedded model_data.h array, so a board flashed without any models
+// still boots the cat detector.
+static void model_slots_init(const unsigned char *part_base) {
+  for (int i = 0; i < MODEL_SLOT_COUNT; i++) {
+    const unsigned char *graph = NULL;
+    if (part_base != NULL) {
+      const unsigned char *bytes = part_base + (size_t)i * MODEL_SLOT_SIZE;
+      if (memcmp(bytes + 4, "TFL3", 4) == 0) {
+        graph = bytes;
+      }
+    }
+    if (graph == NULL && i == 0) {
+      graph = model; // Embedded fallback for the alert slot
+    }
+    model_slots[i].graph = graph;
+    if (graph != NULL) {
+      Serial.printf("Model slot %d (%s): %s\n", i, model_slots[i].name,
+                    graph == model ? "embedded fallback" : "flash-mapped");
+    }
+  }
+}
+
+// Advance the weighted rotation and point the interpreter at that
+// slot's graph. Consecutive turns on one slot skip the re-begin, so
+// the arena replan is paid only on actual switches — the alert slot's
+// back-to-back turns run at full single-model speed. A slot whose
+// graph fails to (re)initialize (bad flatbuffer, arena too small) is
+// unloaded so the rotation skips it from then on. Returns NULL only
+// when no slot is loaded (setup aborts on that). Bounded by two full
+// rotations so an unload mid-scan cannot starve the search.
+static ModelSlot *model_engine_next() {
+  for (int tried = 0; tried <= 2 * MODEL_SLOT_COUNT; tried++) {
+    ModelSlot *slot = &model_slots[sched_slot];
+    if (slot->graph != NULL && sched_turns < slot->weight) {
+      if (active_slot != sched_slot) {
+        if (!ml.begin(slot->graph)) {
+          Serial.printf("Model slot %d (%s): init failed, unloading\n",
+                        sched_slot, slot->name);
+          slot->graph = NULL;
+          active_slot = -1; // Interpreter is torn down
+          sched_slot = (sched_slot + 1) % MODEL_SLOT_COUNT;
+          sched_turns = 0;
+          continue;
+        }
+        active_slot = sched_slot;
+        model_switches++;
+      }
+      sched_turns++;
+      return slot;
+    }
+    sched_slot = (sched_slot + 1) % MODEL_SLOT_COUNT;
+    sched_turns = 0;
+  }
+  return NULL;
+}
+
+// Boot-time proof that slot switching takes effect: run one inference
+// per loaded slot on the same fixed ramp input and print an output
+// signature per slot. Distinct graphs must produce distinct MODELSLOT
+// lines — identical signatures across slots mean re-initialization is
+// silently keeping the first graph (the failure mode of the wrapper
+// this firmware used to pin), which would otherwise be invisible
+// behind healthy-looking rotation counters.
+static void model_slots_verify() {
+  for (int i = 0; i < MODEL_SLOT_COUNT; i++) {
+    ModelSlot *slot = &model_slots[i];
+    if (slot->graph == NULL) {
+      continue;
+    }
+    if (!ml.begin(slot->graph)) {
+      Serial.printf("Model slot %d (%s): init failed, unloading\n",
+                    i, slot->name);
+      slot->graph = NULL;
+      continue;
+    }
+
+#if QUANTIZED_MODEL
+    int8_t *in = ml.getQuantizedInputTensor();
+    for (int j = 0; j < MODEL_INPUT_LEN; j++) {
+      in[j] = (int8_t)((j & 0xFF) + MODEL_INPUT_ZERO_POINT);
+    }
+#else
+    float *in = ml.getInputTensor();
+    for (int j = 0; j < MODEL_INPUT_LEN; j++) {
+      in[j] = (float)(j & 0xFF) / 255.0f;
+    }
+#endif
+    if (!ml.invoke()) {
+      Serial.printf("Model slot %d (%s): verify invoke failed, unloading\n",
+                    i, slot->name);
+      slot->graph = NULL;
+      continue;
+    }
+
+    // Fold the raw output into a 32-bit signature
+    uint32_t sig = 0;
+#if QUANTIZED_MODEL
+    const int8_t *out = ml.getQuantizedOutputTensor();
+    for (int j = 0; j < MODEL_OUTPUT_LEN; j++) {
+      sig = sig * 31 + (uint8_t)out[j];
+    }
+#else
+    const float *out = ml.getOutputTensor();
+    for (int j = 0; j < MODEL_OUTPUT_LEN; j++) {
+      uint32_t bits;
+      memcpy(&bits, &out[j], sizeof(bits));
+      sig = sig * 31 + bits;
+    }
+#endif
+    Serial.printf("MODELSLOT slot=%d name=%s sig=%08X\n",
+                  i, slot->name, (unsigned)sig);
+  }
+  active_slot = -1; // The engine re-begins its first pick
+}
+#endif // MULTI_MODEL
+
+#if DETECTION_UPLINK
+// Detection-event uplink. The inference task offers each valid
+// detection (rate-limited) into a small queue of fixed-size records; a
+// low-priority task owns the hub connection, batches whatever has
+// accumulated and publishes it as one binary frame. Hub down or WiFi
+// out just drops events into a counter — the detection path never
+// blocks on the network.
+
+// One event record, 12 bytes little-endian on the wire:
+//   uint32 timestamp_ms  camera millis() when inference completed
+//   uint16 score_q16     score * 65535
+//   uint8  box[4]        x_min, y_min, x_max, y_max, * 255
+//   uint16 seq           event sequence number (drop detection)
+struct __attribute__((packed)) DetectionEvent {
+  uint32_t timestamp_ms;
+  uint16_t score_q16;
+  uint8_t box[4];
+  uint16_t seq;
+};
+
+static QueueHandle_t uplink_queue = NULL;
+static uint16_t uplink_seq = 0;
+static uint32_t uplink_last_event_ms = 0;
+static uint32_t uplink_events_sent = 0;
+static uint32_t uplink_events_dropped = 0;
+
+// Quantize a 0..1 value into an 8-bit wire field
+static inline uint8_t uplink_q8(float v) {
+  if (v < 0.0f) v = 0.0f;
+  if (v > 1.0f) v = 1.0f;
+  return (uint8_t)(v * 255.0f);
+}
+
+// Offer one detection to the uplink, called from the inference task
+static void uplink_offer(const Detection &det) {
+  uint32_t now = millis();
+  if (uplink_last_event_ms != 0 &&
+      now - uplink_last_event_ms < UPLINK_MIN_EVENT_GAP_MS) {
+    return; // Same sighting, already reported
+  }
+
+  float score = det.score;
+  if (score < 0.0f) score = 0.0f;
+  if (score > 1.0f) score = 1.0f;
+
+  DetectionEvent ev;
+  ev.timestamp_ms = now;
+  ev.score_q16 = (uint16_t)(score * 65535.0f);
+  for (int i = 0; i < 4; i++) {
+    ev.box[i] = uplink_q8(det.box[i]);
+  }
+  ev.seq = ++uplink_seq;
+
+  if (xQueueSend(uplink_queue, &ev, 0) == pdTRUE) {
+    uplink_last_event_ms = now;
+  } else {
+    uplink_events_dropped++;
+  }
+}
+
+// Send one batch as a hub frame: [u16 LE length][opcode][topic][records]
+static bool uplink_send_batch(WiFiClient &hub, const DetectionEvent *events, int count) {
+  uint8_t frame[4 + UPLINK_QUEUE_DEPTH * sizeof(DetectionEvent)];
+  uint16_t payload_len = 2 + count * sizeof(DetectionEvent);
+
+  frameEncodeHeader(frame, payload_len);
+  frame[2] = HUB_OP_PUBLISH;
+  frame[3] = UPLINK_TOPIC;
+  memcpy(&frame[4], events, count * sizeof(DetectionEvent));
+
+  size_t total = 2 + payload_len;
+  return hub.write(frame, total) == total;
+}
+
+// Uplink stage: blocks on the first event, holds the batch window
+// open, then connects (if needed) and publishes everything pending
+void uplink_task(void *arg) {
+  WiFiClient hub;
+  DetectionEvent batch[UPLINK_QUEUE_DEPTH];
+
+  for (;;) {
+    if (xQueueReceive(uplink_queue, &batch[0], portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    int count = 1;
+    vTaskDelay(pdMS_TO_TICKS(UPLINK_FLUSH_MS)); // Batch window
+    while (count < (int)UPLINK_QUEUE_DEPTH &&
+           xQueueReceive(uplink_queue, &batch[count], 0) == pdTRUE) {
+      count++;
+    }
+
+    if (!hub.connected()) {
+      if (WiFi.status() != WL_CONNECTED ||
+          !hub.connect(UPLINK_HOST, UPLINK_PORT)) {
+        uplink_events_dropped += count;
+        vTaskDelay(pdMS_TO_TICKS(UPLINK_RECONNECT_MS));
+        continue;
+      }
+      // Switch the fresh connection into binary framing mode
+      const uint8_t magic[4] = { HUB_FRAMING_MAGIC_0, HUB_FRAMING_MAGIC_1,
+                                 HUB_FRAMING_MAGIC_2, HUB_FRAMING_MAGIC_3 };
+      hub.write(magic, sizeof(magic));
+    }
+
+    if (uplink_send_batch(hub, batch, count)) {
+      uplink_events_sent += count;
+    } else {
+      uplink_events_dropped += count;
+      hub.stop(); // Reconnect on the next batch
+    }
+  }
+}
+#endif // DETECTION_UPLINK
+
 // HTTP Server handles
-httpd_handle_t stream_httpd = NULL;
+httpd_handle_t camera_httpd = NULL;
+
+// Dataset tap (/capture): the exact 96x96 RGB888 tensor-domain image
+// produced by the model's downscale kernel, served as chunked binary.
+// PSRAM-backed, filled on demand only.
+static uint8_t *capture_image = NULL;
+#if NATIVE_JPEG_STREAM
+// Decode scratch for the tap; the handler decodes a borrowed shared
+// JPEG frame here at httpd priority so the pipeline never notices
+static uint8_t *capture_rgb_buf = NULL;
+#else
+// Pre-JPEG tap handshake: the handler raises the request, the capture
+// task runs the kernel on its live RGB565 frame and signals completion
+static volatile bool capture_request = false;
+static SemaphoreHandle_t capture_done = NULL;
+#endif
+
+#if NATIVE_JPEG_STREAM
+// PSRAM scratch the inference task decodes JPEG frames into; allocated
+// once at boot
+static uint8_t *infer_rgb_buf = NULL;
+#endif
+
+#if MOTION_GATE
+// Previous frame's coarse luma grid and gate accounting
+static uint8_t prev_luma[MOTION_GRID_W * MOTION_GRID_H];
+static bool prev_luma_valid = false;
+static uint32_t motion_gate_skips = 0;
+static uint32_t motion_gate_runs = 0;
+
+#if NATIVE_JPEG_STREAM
+// Internal-RAM scratch for the 1/8-scale gate decode (40x30 RGB565 at
+// QVGA)
+static uint8_t gate_rgb_buf[40 * 30 * 2];
+#endif
+#endif
 
 // Function prototypes
 void startCameraServer();
-void draw_box(uint8_t *buf, int width, int height, int x_min, int y_min, int x_max, int y_max, uint16_t color);
-void process_detection();
+#if !QUANTIZED_MODEL
+void init_pixel_lut();
+#endif
+void preprocess_frame(const uint8_t *buf, int width, int height);
+void downscale_to_rgb888(const uint8_t *buf, int width, int height, uint8_t *dst);
+Detection run_model();
+void inference_task(void *arg);
+void capture_encode_task(void *arg);
+void publish_frame(uint8_t *buf, size_t len);
+SharedFrame *acquire_frame(uint32_t last_seq, uint32_t timeout_ms, int waiter);
+void release_frame(SharedFrame *frame);
+#if !NATIVE_JPEG_STREAM
+bool overlay_compose(uint8_t *buf, int width, int height, int x_min, int y_min, int x_max, int y_max, uint16_t color);
+void overlay_restore(uint8_t *buf, int width);
+#endif
 
-void setup() {
-  Serial.begin(115200);
-  Serial.setDebugOutput(true);
-  Serial.println();
+#if MODEL_FROM_PARTITION
+/**
+ * Memory-map the model from its flash partition.
+ *
+ * The mapped pointer goes straight to the interpreter — flash is in
+ * the cache-backed address space, so weights are read on demand like
+ * the old embedded array but without being part of the app binary or
+ * copied anywhere at boot. Returns NULL (caller falls back to the
+ * model_data.h array) when the partition is absent or its first bytes
+ * are not a TFLite flatbuffer, so a board flashed without a model
+ * still boots.
+ */
+static const unsigned char *map_model_partition() {
+  const esp_partition_t *part = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, MODEL_PARTITION_LABEL);
+  if (part == NULL) {
+    Serial.println("Model partition not found; using embedded model");
+    return NULL;
+  }
 
-  // 1. Initialize PSRAM
-  if (psramFound()) {
-    Serial.println("PSRAM detected and initialized.");
-    // Configure camera to use PSRAM for frame buffers
-    config.frame_size = FRAMESIZE_SVGA;
-  } else {
-    Serial.println("PSRAM not found. Reducing frame buffer allocation.");
-    config.frame_size = FRAMESIZE_QVGA;
+  const void *mapped = NULL;
+  spi_flash_mmap_handle_t handle;
+  esp_err_t err = esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA,
+                                     &mapped, &handle);
+  if (err != ESP_OK) {
+    Serial.printf("Model partition mmap failed with error 0x%x\n", err);
+    return NULL;
   }
 
-  // 2. Initialize Camera
+  const unsigned char *bytes = (const unsigned char *)mapped;
+#if MULTI_MODEL
+  // Validity is probed per sub-slot by model_slots_init(); an empty
+  // slot 0 just falls back to the embedded model
+#else
+  // Sanity check: a TFLite flatbuffer carries the "TFL3" identifier at
+  // offset 4
+  if (memcmp(bytes + 4, "TFL3", 4) != 0) {
+    Serial.println("Model partition holds no TFLite model; using embedded model");
+    spi_flash_munmap(handle);
+    return NULL;
+  }
+#endif
+
+  Serial.printf("Model mapped from flash partition '%s' (%u KB)\n",
+                MODEL_PARTITION_LABEL, part->size / 1024);
+  return bytes;
+}
+#endif // MODEL_FROM_PARTITION
+
+// NVS-backed fast reconnect cache (namespace "wifi": the AP's BSSID
+// and channel from the last successful association)
+static Preferences wifi_prefs;
+
+/**
+ * Kick off WiFi association without blocking.
+ *
+ * When the NVS cache holds the AP's BSSID and channel from a previous
+ * association, they are passed to WiFi.begin() so the radio goes
+ * straight to the right channel instead of scanning all of them —
+ * the difference between 3-8 s and a few hundred ms after a brownout.
+ * Returns true when the cached fast path was attempted, so the wait
+ * loop knows to fall back to a full scan on timeout.
+ */
+static bool wifi_begin_fast() {
+#if USE_STATIC_IP
+  IPAddress ip, gateway, subnet;
+  if (ip.fromString(STATIC_IP) && gateway.fromString(STATIC_GATEWAY) &&
+      subnet.fromString(STATIC_SUBNET)) {
+    WiFi.config(ip, gateway, subnet); // Skip DHCP too
+  }
+#endif
+
+  wifi_prefs.begin("wifi", false);
+  uint8_t bssid[6];
+  uint8_t channel = wifi_prefs.getUChar("chan", 0);
+  size_t got = wifi_prefs.getBytes("bssid", bssid, sizeof(bssid));
+
+  Serial.printf("Connecting to %s ", WIFI_SSID);
+  if (channel != 0 && got == sizeof(bssid)) {
+    Serial.printf("(fast reconnect, channel %u) ", channel);
+    WiFi.begin(WIFI_SSID, WIFI_PASS, channel, bssid);
+    return true;
+  }
+  WiFi.begin(WIFI_SSID, WIFI_PASS);
+  return false;
+}
+
+// Block until association completes. A fast-reconnect attempt that
+// outlives its timeout (AP rebooted onto another channel, or replaced
+// hardware) is restarted as a full scan.
+static void wifi_wait_connected(bool fast_attempt) {
+  uint32_t started = millis();
+  while (WiFi.status() != WL_CONNECTED) {
+    if (fast_attempt && millis() - started > WIFI_FAST_CONNECT_TIMEOUT_MS) {
+      Serial.println("\nFast reconnect timed out; falling back to full scan");
+      WiFi.disconnect();
+      WiFi.begin(WIFI_SSID, WIFI_PASS);
+      fast_attempt = false;
+    }
+    delay(50);
+  }
+  Serial.println("\nWiFi connected");
+
+  // Refresh the cache when the AP moved (or was never cached)
+  uint8_t cached[6] = {};
+  uint8_t *bssid = WiFi.BSSID();
+  uint8_t channel = (uint8_t)WiFi.channel();
+  wifi_prefs.getBytes("bssid", cached, sizeof(cached));
+  if (bssid != NULL &&
+      (memcmp(cached, bssid, 6) != 0 || wifi_prefs.getUChar("chan", 0) != channel)) {
+    wifi_prefs.putBytes("bssid", bssid, 6);
+    wifi_prefs.putUChar("chan", channel);
+    Serial.printf("Cached AP for fast reconnect (channel %u)\n", channel);
+  }
+}
+
+#if !MULTI_MODEL || BENCH_MODE
+// Pick the model to hand to ml.begin(): the flash partition when it
+// holds one, the embedded model_data.h array otherwise. The benchmark
+// build uses this too — it times the alert model alone.
+static const unsigned char *load_model() {
+#if MODEL_FROM_PARTITION
+  const unsigned char *mapped = map_model_partition();
+#if MULTI_MODEL
+  // The multi-model map defers the magic check to the slot probe;
+  // redo it here since this path bypasses the probe
+  if (mapped != NULL && memcmp(mapped + 4, "TFL3", 4) != 0) {
+    mapped = NULL;
+  }
+#endif
+  if (mapped != NULL) {
+    return mapped;
+  }
+#endif
+  return model;
+}
+#endif // !MULTI_MODEL || BENCH_MODE
+
+// Configure and start the camera driver. Shared by the normal firmware
+// and the benchmark build so both measure the same sensor settings.
+static bool init_camera() {
   camera_config_t camera_config = {
     .pin_pwdn = PWDN_GPIO_NUM,
     .pin_reset = RESET_GPIO_NUM,
@@ -73,165 +869,1231 @@ void setup() {
     .pin_pclk = PCLK_GPIO_NUM,
 
     .xclk_freq_hz = 20000000,
+#if NATIVE_JPEG_STREAM
+    .pixel_format = PIXFORMAT_JPEG,   // Hardware-encoded by the sensor
+#else
     .pixel_format = PIXFORMAT_RGB565, // RGB565 for easier drawing
+#endif
     .frame_size = FRAMESIZE_QVGA,     // 320x240
-    .jpeg_quality = 12,
-    .fb_count = 2,
+    .jpeg_quality = JPEG_SENSOR_QUALITY,
+    .fb_count = CAPTURE_FB_COUNT,
     .fb_location = CAMERA_FB_IN_PSRAM,
-    .grab_mode = CAMERA_GRAB_WHEN_EMPTY
+    .grab_mode = CAPTURE_GRAB_MODE
   };
 
+  // Check PSRAM before committing to larger frame buffers
+  if (psramFound()) {
+    Serial.println("PSRAM detected and initialized.");
+  } else {
+    Serial.println("PSRAM not found. Keeping QVGA frame buffers in DRAM.");
+    camera_config.fb_location = CAMERA_FB_IN_DRAM;
+    camera_config.fb_count = 1;
+  }
+
   // Initialize camera driver
   esp_err_t err = esp_camera_init(&camera_config);
   if (err != ESP_OK) {
     Serial.printf("Camera init failed with error 0x%x", err);
-    return;
+    return false;
   }
   camera_initialized = true;
   Serial.println("Camera initialized successfully");
+  return true;
+}
 
-  // 3. Initialize WiFi
-  Serial.printf("Connecting to %s ", WIFI_SSID);
-  WiFi.begin(WIFI_SSID, WIFI_PASS);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+#if !BENCH_MODE
+void setup() {
+  Serial.begin(115200);
+  Serial.setDebugOutput(true);
+  Serial.println();
+
+  // 1. Kick off WiFi association — the radio associates on its own
+  // while the camera and model initialize below, instead of the old
+  // strictly sequenced camera-then-scan-then-model boot
+  bool fast_connect = wifi_begin_fast();
+
+  // 2. Initialize Camera
+  if (!init_camera()) {
+    return;
   }
-  Serial.println("\nWiFi connected");
-  Serial.print("Camera Stream Ready! Go to: http://");
-  Serial.print(WiFi.localIP());
 
-  // 4. Initialize TFLite Model
-  ml.begin(model);
+  // 3. Initialize TFLite Model and the preprocessing LUT
+#if !QUANTIZED_MODEL
+  init_pixel_lut();
+#endif
+#if MULTI_MODEL
+#if MODEL_FROM_PARTITION
+  model_slots_init(map_model_partition());
+#else
+  model_slots_init(NULL);
+#endif
+  model_slots_verify();
+  if (model_engine_next() == NULL) {
+    Serial.println("No model available");
+    return;
+  }
+  Serial.println("TFLite model slots loaded");
+#else
+  if (!ml.begin(load_model())) {
+    Serial.println("Model initialization failed");
+    return;
+  }
   Serial.println("TFLite Model loaded");
+#endif
+
+#if NATIVE_JPEG_STREAM
+  // Scratch the inference stage decodes into; QVGA RGB565 lives in
+  // PSRAM
+  infer_rgb_buf = (uint8_t *)ps_malloc(320 * 240 * 2);
+  if (!infer_rgb_buf) {
+    Serial.println("Inference scratch allocation failed");
+    return;
+  }
+#endif
 
-  // 5. Start Web Server
+  // Allocate the stream JPEG arena: FRAME_POOL_SIZE fixed PSRAM
+  // buffers, reused for every frame from here on
+  for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+    jpeg_arena[i] = (uint8_t *)ps_malloc(STREAM_JPEG_BUF_SIZE);
+    if (jpeg_arena[i] == NULL) {
+      Serial.println("JPEG arena allocation failed");
+      return;
+    }
+  }
+  poolInit(jpeg_pool, jpeg_arena, jpeg_arena_busy, FRAME_POOL_SIZE);
+
+  // Dataset tap buffer (/capture): the 96x96 RGB888 tensor-domain image
+  capture_image = (uint8_t *)ps_malloc(INPUT_WIDTH * INPUT_HEIGHT * 3);
+  if (!capture_image) {
+    Serial.println("Capture tap allocation failed");
+    return;
+  }
+#if NATIVE_JPEG_STREAM
+  // Decode scratch the /capture handler expands the shared JPEG into
+  capture_rgb_buf = (uint8_t *)ps_malloc(320 * 240 * 2);
+  if (!capture_rgb_buf) {
+    Serial.println("Capture scratch allocation failed");
+    return;
+  }
+#else
+  capture_done = xSemaphoreCreateBinary();
+  if (!capture_done) {
+    Serial.println("Capture semaphore creation failed");
+    return;
+  }
+#endif
+
+  // 4. Create pipeline handoffs and start the stage tasks
+  infer_queue = xQueueCreate(1, sizeof(camera_fb_t *));
+  infer_copied = xSemaphoreCreateBinary();
+  if (!infer_queue || !infer_copied) {
+    Serial.println("Pipeline queue creation failed");
+    return;
+  }
+
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    frame_waiters[i] = xSemaphoreCreateBinary();
+    if (!frame_waiters[i]) {
+      Serial.println("Frame waiter creation failed");
+      return;
+    }
+  }
+
+#if DETECTION_UPLINK
+  uplink_queue = xQueueCreate(UPLINK_QUEUE_DEPTH, sizeof(DetectionEvent));
+  if (!uplink_queue) {
+    Serial.println("Uplink queue creation failed");
+    return;
+  }
+  xTaskCreatePinnedToCore(uplink_task, "uplink", UPLINK_TASK_STACK_SIZE, NULL,
+                          UPLINK_TASK_PRIORITY, NULL, UPLINK_TASK_CORE);
+#endif
+
+  // The pipeline runs fine before WiFi is up — the stream just has no
+  // viewers yet — so first frames are already flowing when the server
+  // starts
+  xTaskCreatePinnedToCore(inference_task, "infer", INFER_TASK_STACK_SIZE, NULL,
+                          INFER_TASK_PRIORITY, NULL, INFER_TASK_CORE);
+  xTaskCreatePinnedToCore(capture_encode_task, "capture", CAPTURE_TASK_STACK_SIZE, NULL,
+                          CAPTURE_TASK_PRIORITY, NULL, CAPTURE_TASK_CORE);
+
+  // 5. Wait out association and start the Web Server
+  wifi_wait_connected(fast_connect);
+  Serial.print("Camera Stream Ready! Go to: http://");
+  Serial.println(WiFi.localIP());
   startCameraServer();
 }
 
 void loop() {
-  // Main loop is handled by the web server handlers
-  // We can perform periodic tasks here if needed
-  delay(1000);
+  // All work happens in the pipeline tasks and HTTP handlers; the
+  // Arduino loop task has no events to wait on, so park it instead of
+  // waking every second for nothing
+  vTaskDelay(portMAX_DELAY);
 }
 
-// Helper to draw bounding box on RGB565 buffer
-void draw_box(uint8_t *buf, int width, int height, int x_min, int y_min, int x_max, int y_max, uint16_t color) {
-  // Clamp coordinates
+#else // BENCH_MODE
+
+#if NATIVE_JPEG_STREAM
+#error "BENCH_MODE requires RGB565 capture; build with -DNATIVE_JPEG_STREAM=0"
+#endif
+
+// ---------------------------------------------------------------------
+// Boot-time scripted benchmark (esp32cam_bench environment).
+//
+// Runs each pipeline stage in isolation for BENCH_ITERATIONS
+// iterations against a captured reference frame and prints one
+// machine-parseable line per stage:
+//
+//   CAMBENCH stage=<name> n=<count> mean_us=<u> p95_us=<u> max_us=<u>
+//
+// so A/B runs (quantized vs float model, gate on vs off, sensor
+// quality settings) can be diffed by a script instead of eyeballed
+// from the serial monitor. No WiFi and no HTTP server: nothing
+// competes with the stage under test.
+// ---------------------------------------------------------------------
+
+static uint32_t bench_samples[BENCH_ITERATIONS];
+static uint8_t *bench_frame = NULL; // Reference RGB565 frame (PSRAM)
+static int bench_frame_w = 0;
+static int bench_frame_h = 0;
+static size_t bench_frame_len = 0;
+
+static int bench_compare_u32(const void *a, const void *b) {
+  uint32_t ua = *(const uint32_t *)a;
+  uint32_t ub = *(const uint32_t *)b;
+  return (ua > ub) - (ua < ub);
+}
+
+static inline uint32_t bench_elapsed_us(uint32_t start_cycles) {
+  return (stats_now() - start_cycles) / STATS_CYCLES_PER_US;
+}
+
+// Sort the sample set and print the stage's aggregate line
+static void bench_report(const char *stage, int n) {
+  qsort(bench_samples, n, sizeof(uint32_t), bench_compare_u32);
+  uint64_t sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += bench_samples[i];
+  }
+  Serial.printf("CAMBENCH stage=%s n=%d mean_us=%u p95_us=%u max_us=%u\n",
+                stage, n, (uint32_t)(sum / n),
+                bench_samples[(n * 95) / 100], bench_samples[n - 1]);
+}
+
+static void bench_run() {
+  Serial.printf("CAMBENCH begin iterations=%d quantized=%d motion_gate=%d jpeg_quality=%d\n",
+                BENCH_ITERATIONS, QUANTIZED_MODEL, MOTION_GATE, JPEG_STREAM_QUALITY);
+
+  // Stage 1: capture. fb_get/fb_return round trips at sensor rate; the
+  // last frame is kept as the reference input for the later stages.
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    uint32_t t = stats_now();
+    camera_fb_t *fb = esp_camera_fb_get();
+    bench_samples[i] = bench_elapsed_us(t);
+    if (!fb) {
+      Serial.println("CAMBENCH error stage=capture");
+      return;
+    }
+    if (i == BENCH_ITERATIONS - 1 && fb->len <= 320 * 240 * 2) {
+      memcpy(bench_frame, fb->buf, fb->len);
+      bench_frame_w = fb->width;
+      bench_frame_h = fb->height;
+      bench_frame_len = fb->len;
+    }
+    esp_camera_fb_return(fb);
+  }
+  bench_report("capture", BENCH_ITERATIONS);
+  if (bench_frame_len == 0) {
+    Serial.println("CAMBENCH error stage=reference_frame");
+    return;
+  }
+
+  // Stage 2: the fixed-point preprocessing kernel
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    uint32_t t = stats_now();
+    preprocess_frame(bench_frame, bench_frame_w, bench_frame_h);
+    bench_samples[i] = bench_elapsed_us(t);
+  }
+  bench_report("preprocess", BENCH_ITERATIONS);
+
+  // Stage 3: model invocation on the tensor the kernel just filled
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    uint32_t t = stats_now();
+    run_model();
+    bench_samples[i] = bench_elapsed_us(t);
+  }
+  bench_report("predict", BENCH_ITERATIONS);
+
+  // Stage 4: software JPEG encode into a recycled arena buffer
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    JpgEncodeCtx ctx = {};
+    ctx.buf = jpeg_arena[0];
+    uint32_t t = stats_now();
+    bool ok = fmt2jpg_cb(bench_frame, bench_frame_len,
+                         bench_frame_w, bench_frame_h, PIXFORMAT_RGB565,
+                         JPEG_STREAM_QUALITY, jpg_arena_write_cb, &ctx);
+    bench_samples[i] = bench_elapsed_us(t);
+    if (!ok || ctx.overflow) {
+      Serial.println("CAMBENCH error stage=fmt2jpg");
+      return;
+    }
+  }
+  bench_report("fmt2jpg", BENCH_ITERATIONS);
+
+  // Stage 5: overlay compositor round trip (compose + restore) across
+  // most of the frame
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    uint32_t t = stats_now();
+    overlay_compose(bench_frame, bench_frame_w, bench_frame_h,
+                    16, 12, bench_frame_w - 16, bench_frame_h - 12, 0x07E0);
+    overlay_restore(bench_frame, bench_frame_w);
+    bench_samples[i] = bench_elapsed_us(t);
+  }
+  bench_report("overlay", BENCH_ITERATIONS);
+
+  Serial.println("CAMBENCH end");
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println();
+  Serial.println("Benchmark build (BENCH_MODE)");
+
+  if (!init_camera()) {
+    return;
+  }
+
+  bench_frame = (uint8_t *)ps_malloc(320 * 240 * 2);
+  jpeg_arena[0] = (uint8_t *)ps_malloc(STREAM_JPEG_BUF_SIZE);
+  if (bench_frame == NULL || jpeg_arena[0] == NULL) {
+    Serial.println("Benchmark buffer allocation failed");
+    return;
+  }
+
+#if !QUANTIZED_MODEL
+  init_pixel_lut();
+#endif
+  if (!ml.begin(load_model())) {
+    Serial.println("Model initialization failed");
+    return;
+  }
+  Serial.println("TFLite Model loaded");
+
+  bench_run();
+}
+
+void loop() {
+  delay(1000); // Benchmark runs once from setup()
+}
+
+#endif // BENCH_MODE
+
+#if !QUANTIZED_MODEL
+// Fill the uint8 -> normalized-float lookup table once at boot, so the
+// tensor fill is a table load per channel instead of a float divide.
+void init_pixel_lut() {
+  for (int i = 0; i < 256; i++) {
+    pixel_norm_lut[i] = (float)i / 255.0f;
+  }
+}
+#endif
+
+// RGB565 (byte-swapped, as the camera stores it) -> RGB888, shifts and
+// masks only, replicating top bits into the low end. Shared by the
+// model kernel and the dataset tap so both produce identical pixels.
+static inline void rgb565_expand(uint16_t px, uint8_t *r, uint8_t *g, uint8_t *b) {
+  px = (px >> 8) | (px << 8);
+  *r = ((px >> 11) << 3) | ((px >> 13) & 0x07);
+  *g = (((px >> 5) << 2) & 0xFC) | ((px >> 9) & 0x03);
+  *b = ((px << 3) & 0xF8) | ((px >> 2) & 0x07);
+}
+
+/**
+ * Fixed-point preprocessing kernel.
+ *
+ * Downsamples the RGB565 frame buffer to INPUT_WIDTH x INPUT_HEIGHT,
+ * expands it to RGB888 and writes straight into the interpreter's
+ * input tensor (int8 with the quantization offset, or floats via the
+ * LUT). Source coordinates step in 16.16 fixed point (nearest
+ * neighbor), and each output row walks a single source row left to
+ * right, so the PSRAM frame buffer is read in cache-friendly order.
+ * RGB565 -> RGB888 expansion is shifts and masks only. No per-pixel
+ * float math anywhere.
+ */
+void preprocess_frame(const uint8_t *buf, int width, int height) {
+  const uint16_t *src = (const uint16_t *)buf;
+
+  // 16.16 fixed-point source step per output pixel
+  const uint32_t x_step = ((uint32_t)width << 16) / INPUT_WIDTH;
+  const uint32_t y_step = ((uint32_t)height << 16) / INPUT_HEIGHT;
+
+#if QUANTIZED_MODEL
+  // Write int8 pixels straight into the interpreter's input tensor:
+  // q = v + zero_point with the standard 1/255 input scale
+  int8_t *dst = ml.getQuantizedInputTensor();
+#else
+  // Write normalized floats straight into the input tensor, one LUT
+  // load per channel
+  float *dst = ml.getInputTensor();
+#endif
+  uint32_t y_acc = y_step / 2; // Sample pixel centers
+
+  for (int oy = 0; oy < INPUT_HEIGHT; oy++) {
+    const uint16_t *row = src + (y_acc >> 16) * width;
+    uint32_t x_acc = x_step / 2;
+
+    for (int ox = 0; ox < INPUT_WIDTH; ox++) {
+      uint8_t r, g, b;
+      rgb565_expand(row[x_acc >> 16], &r, &g, &b);
+
+#if QUANTIZED_MODEL
+      *dst++ = (int8_t)(r + MODEL_INPUT_ZERO_POINT);
+      *dst++ = (int8_t)(g + MODEL_INPUT_ZERO_POINT);
+      *dst++ = (int8_t)(b + MODEL_INPUT_ZERO_POINT);
+#else
+      *dst++ = pixel_norm_lut[r];
+      *dst++ = pixel_norm_lut[g];
+      *dst++ = pixel_norm_lut[b];
+#endif
+
+      x_acc += x_step;
+    }
+    y_acc += y_step;
+  }
+}
+
+/**
+ * Dataset-tap variant of the kernel: identical 16.16 stepping and
+ * pixel expansion, but writing plain RGB888 bytes into dst instead of
+ * the model tensor, so a /capture image is exactly what the model
+ * would see (before the quantization offset).
+ */
+void downscale_to_rgb888(const uint8_t *buf, int width, int height, uint8_t *dst) {
+  const uint16_t *src = (const uint16_t *)buf;
+  const uint32_t x_step = ((uint32_t)width << 16) / INPUT_WIDTH;
+  const uint32_t y_step = ((uint32_t)height << 16) / INPUT_HEIGHT;
+
+  uint32_t y_acc = y_step / 2;
+  for (int oy = 0; oy < INPUT_HEIGHT; oy++) {
+    const uint16_t *row = src + (y_acc >> 16) * width;
+    uint32_t x_acc = x_step / 2;
+    for (int ox = 0; ox < INPUT_WIDTH; ox++) {
+      rgb565_expand(row[x_acc >> 16], &dst[0], &dst[1], &dst[2]);
+      dst += 3;
+      x_acc += x_step;
+    }
+    y_acc += y_step;
+  }
+}
+
+#if MOTION_GATE
+/**
+ * Coarse frame-difference motion gate.
+ *
+ * Samples the RGB565 buffer down to a MOTION_GRID_W x MOTION_GRID_H
+ * luma grid (integer-only: y = (r + 2g + b) / 4 on shift-expanded
+ * channels), then sums absolute differences against the reference grid
+ * in 8x8-cell blocks. Returns true when enough blocks moved. The
+ * reference is replaced only when the gate fires, so motion too slow
+ * to clear the threshold between two samples keeps accumulating
+ * against the stored reference until it does.
+ */
+bool motion_detected(const uint8_t *buf, int width, int height) {
+  const uint16_t *src = (const uint16_t *)buf;
+  uint8_t luma[MOTION_GRID_W * MOTION_GRID_H];
+
+  const uint32_t x_step = ((uint32_t)width << 16) / MOTION_GRID_W;
+  const uint32_t y_step = ((uint32_t)height << 16) / MOTION_GRID_H;
+
+  uint8_t *dst = luma;
+  uint32_t y_acc = y_step / 2;
+  for (int gy = 0; gy < MOTION_GRID_H; gy++) {
+    const uint16_t *row = src + (y_acc >> 16) * width;
+    uint32_t x_acc = x_step / 2;
+    for (int gx = 0; gx < MOTION_GRID_W; gx++) {
+      uint16_t px = row[x_acc >> 16];
+      px = (px >> 8) | (px << 8);
+      uint32_t r = (px >> 11) << 3;
+      uint32_t g = ((px >> 5) << 2) & 0xFC;
+      uint32_t b = (px << 3) & 0xF8;
+      *dst++ = (uint8_t)((r + 2 * g + b) >> 2);
+      x_acc += x_step;
+    }
+    y_acc += y_step;
+  }
+
+  bool moved = false;
+  if (prev_luma_valid) {
+    // Blockwise SAD over 8x8 cells of the grid
+    int changed_blocks = 0;
+    for (int by = 0; by < MOTION_GRID_H; by += 8) {
+      for (int bx = 0; bx < MOTION_GRID_W; bx += 8) {
+        uint32_t sad = 0;
+        for (int y = by; y < by + 8; y++) {
+          for (int x = bx; x < bx + 8; x++) {
+            int idx = y * MOTION_GRID_W + x;
+            sad += abs((int)luma[idx] - (int)prev_luma[idx]);
+          }
+        }
+        if (sad / 64 > MOTION_BLOCK_THRESHOLD) {
+          changed_blocks++;
+        }
+      }
+    }
+    moved = changed_blocks >= MOTION_MIN_BLOCKS;
+  } else {
+    moved = true; // First frame: no reference yet, let it through
+  }
+
+  if (moved) {
+    memcpy(prev_luma, luma, sizeof(luma));
+    prev_luma_valid = true;
+  }
+  return moved;
+}
+#endif // MOTION_GATE
+
+// Run the model on the already-filled input tensor and parse its
+// output ([not_cat, cat, x_min, y_min, x_max, y_max]) into a Detection.
+Detection run_model() {
+  Detection det = {};
+
+#if QUANTIZED_MODEL
+  // Input tensor was filled in place by the kernel; just run the
+  // int8 graph and dequantize the six outputs
+  if (!ml.invoke()) {
+    Serial.println("Inference failed");
+    return det;
+  }
+
+  int8_t *output = ml.getQuantizedOutputTensor();
+  det.score = (output[1] - MODEL_OUTPUT_ZERO_POINT) * MODEL_OUTPUT_SCALE;
+  det.valid = det.score > DETECTION_THRESHOLD;
+  for (int i = 0; i < 4; i++) {
+    det.box[i] = (output[2 + i] - MODEL_OUTPUT_ZERO_POINT) * MODEL_OUTPUT_SCALE;
+  }
+#else
+  // Input tensor was filled in place by the kernel, same as the
+  // quantized build
+  if (!ml.invoke()) {
+    Serial.println("Inference failed");
+    return det;
+  }
+
+  float *output = ml.getOutputTensor();
+  det.score = output[1];
+  det.valid = det.score > DETECTION_THRESHOLD;
+  for (int i = 0; i < 4; i++) {
+    det.box[i] = output[2 + i];
+  }
+#endif
+  return det;
+}
+
+// Retire a pool slot if nothing references it anymore. Must be called
+// with frame_mux held; returns the buffer to free outside the lock (or
+// NULL).
+static uint8_t *retire_frame_locked(SharedFrame *frame) {
+  if (frame != NULL && frame->in_use && frame != current_frame && frame->refs == 0) {
+    uint8_t *buf = frame->buf;
+    frame->buf = NULL;
+    frame->in_use = false;
+    return buf;
+  }
+  return NULL;
+}
+
+// Publish one encoded frame to every stream client. Takes ownership of
+// buf; if no pool slot is free (all frames still held by slow clients)
+// the frame is dropped and counted.
+void publish_frame(uint8_t *buf, size_t len) {
+  uint8_t *to_free = NULL;
+
+  taskENTER_CRITICAL(&frame_mux);
+  SharedFrame *slot = NULL;
+  for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+    if (!frame_pool[i].in_use) {
+      slot = &frame_pool[i];
+      break;
+    }
+  }
+
+  if (slot != NULL) {
+    slot->buf = buf;
+    slot->len = len;
+    slot->seq = ++publish_seq;
+    slot->refs = 0;
+    slot->in_use = true;
+
+    SharedFrame *old = current_frame;
+    current_frame = slot;
+    to_free = retire_frame_locked(old);
+  } else {
+    frames_dropped_no_slot++;
+  }
+  taskEXIT_CRITICAL(&frame_mux);
+
+  if (slot == NULL) {
+    arena_release(buf);
+  }
+  if (to_free != NULL) {
+    arena_release(to_free);
+  }
+
+  // Wake every waiting stream sender
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    if (frame_waiter_claimed[i] && frame_waiters[i] != NULL) {
+      xSemaphoreGive(frame_waiters[i]);
+    }
+  }
+}
+
+// Block until a frame newer than last_seq is available (or the timeout
+// passes) and pin it with a reference. A claimed waiter slot sleeps on
+// its semaphore until publish_frame signals a fresh frame; a slotless
+// caller (waiter -1, the /capture tap) polls on a one-tick delay
+// instead.
+SharedFrame *acquire_frame(uint32_t last_seq, uint32_t timeout_ms, int waiter) {
+  uint32_t deadline = millis() + timeout_ms;
+
+  for (;;) {
+    SharedFrame *frame = NULL;
+    taskENTER_CRITICAL(&frame_mux);
+    if (current_frame != NULL && current_frame->seq != last_seq) {
+      frame = current_frame;
+      frame->refs++;
+    }
+    taskEXIT_CRITICAL(&frame_mux);
+
+    if (frame != NULL) {
+      return frame;
+    }
+    uint32_t now = millis();
+    if (now >= deadline) {
+      return NULL;
+    }
+    if (waiter >= 0) {
+      xSemaphoreTake(frame_waiters[waiter], pdMS_TO_TICKS(deadline - now));
+    } else {
+      vTaskDelay(1);
+    }
+  }
+}
+
+// Drop a reference taken by acquire_frame, freeing the buffer if the
+// frame has been superseded and this was the last sender.
+void release_frame(SharedFrame *frame) {
+  uint8_t *to_free = NULL;
+
+  taskENTER_CRITICAL(&frame_mux);
+  frame->refs--;
+  to_free = retire_frame_locked(frame);
+  taskEXIT_CRITICAL(&frame_mux);
+
+  if (to_free != NULL) {
+    arena_release(to_free);
+  }
+}
+
+// Inference stage. Borrows each frame only long enough for the
+// preprocessing copy-out, releases it back to the encode stage via the
+// infer_copied semaphore, then runs the model while the other core
+// encodes. Publishes the completed detection for the overlay.
+void inference_task(void *arg) {
+  for (;;) {
+    camera_fb_t *fb = NULL;
+    if (xQueueReceive(infer_queue, &fb, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    uint32_t t_infer = stats_now();
+
+#if NATIVE_JPEG_STREAM
+    int width = fb->width;
+    int height = fb->height;
+
+#if MOTION_GATE
+    // Gate on a 1/8-scale decode before paying for the full one
+    bool gate_ok = jpg2rgb565(fb->buf, fb->len, gate_rgb_buf, JPG_SCALE_8X);
+    if (gate_ok && !motion_detected(gate_rgb_buf, width / 8, height / 8)) {
+      xSemaphoreGive(infer_copied); // Static scene: skip this frame
+      motion_gate_skips++;
+      continue;
+    }
+    motion_gate_runs++;
+#endif
+
+    // Decode the sensor JPEG to RGB565 scratch — the only full RGB
+    // conversion anywhere, and only on inference frames with motion
+    bool decoded = jpg2rgb565(fb->buf, fb->len, infer_rgb_buf, JPG_SCALE_NONE);
+    xSemaphoreGive(infer_copied); // Frame buffer is free to stream
+    if (!decoded) {
+      Serial.println("JPEG decode for inference failed");
+      continue;
+    }
+#if MULTI_MODEL
+    // This cycle belongs to the next slot in the rotation. Selected
+    // before preprocessing because a switch replans the arena, which
+    // moves the input tensor the kernel writes into.
+    ModelSlot *slot = model_engine_next();
+#endif
+    preprocess_frame(infer_rgb_buf, width, height);
+#else
+#if MOTION_GATE
+    // Static scene: skip preprocessing and the model entirely
+    if (!motion_detected(fb->buf, fb->width, fb->height)) {
+      xSemaphoreGive(infer_copied);
+      motion_gate_skips++;
+      continue;
+    }
+    motion_gate_runs++;
+#endif
+#if MULTI_MODEL
+    // Slot selection precedes preprocessing: a switch replans the
+    // arena, which moves the input tensor the kernel writes into
+    ModelSlot *slot = model_engine_next();
+#endif
+    preprocess_frame(fb->buf, fb->width, fb->height);
+    xSemaphoreGive(infer_copied); // Frame buffer is free to encode
+#endif
+
+    Detection det = run_model();
+    stats_record(STAGE_INFER, t_infer);
+
+#if MULTI_MODEL
+    slot->runs++;
+    if (det.valid) {
+      slot->hits++;
+    }
+    if (slot->kind == SLOT_REJECT) {
+      // A non-cat is the likely subject: open the alert holdoff
+      // window. The overlay keeps showing the alert model's state.
+      if (det.valid) {
+        reject_until_ms = millis() + REJECT_HOLDOFF_MS;
+        Serial.printf("%s detected: %.2f%% (alerts held)\n",
+                      slot->name, det.score * 100);
+      }
+      continue;
+    }
+#endif
+
+    taskENTER_CRITICAL(&detection_mux);
+    latest_detection = det;
+    taskEXIT_CRITICAL(&detection_mux);
+
+    if (det.valid) {
+      Serial.printf("Cat detected: %.2f%%\n", det.score * 100);
+#if DETECTION_UPLINK
+#if MULTI_MODEL
+      if (reject_veto_active()) {
+        reject_vetoes++;
+      } else {
+        uplink_offer(det);
+      }
+#else
+      uplink_offer(det);
+#endif
+#endif
+    }
+  }
+}
+
+#if LOW_LATENCY_CAPTURE
+// Latest-frame grab drop accounting. The driver overwrites stale
+// frames silently, so skipped frames are inferred from sensor
+// timestamp gaps measured against the shortest frame interval seen.
+static uint32_t capture_frame_interval_us = 0; // Shortest observed
+static int64_t capture_last_ts_us = 0;
+static uint32_t capture_frames_skipped = 0;
+
+static void capture_account_drops(const camera_fb_t *fb) {
+  int64_t ts = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+  if (capture_last_ts_us != 0 && ts > capture_last_ts_us) {
+    uint32_t delta = (uint32_t)(ts - capture_last_ts_us);
+    if (capture_frame_interval_us == 0 || delta < capture_frame_interval_us) {
+      capture_frame_interval_us = delta;
+    }
+    // Whole frame times the driver skipped past, rounded to absorb
+    // sensor jitter
+    capture_frames_skipped +=
+        (delta + capture_frame_interval_us / 2) / capture_frame_interval_us - 1;
+  }
+  capture_last_ts_us = ts;
+}
+#endif // LOW_LATENCY_CAPTURE
+
+// Capture/encode stage. Grabs frames, offers each to the inference
+// stage (skipping the offer when the model is still busy), overlays the
+// most recent detection, encodes to JPEG and queues the result for the
+// stream sender, dropping the oldest frame when the sender lags.
+void capture_encode_task(void *arg) {
+  uint32_t frame_counter = 0;
+
+  for (;;) {
+#if ADAPTIVE_STREAM
+    // Apply a pending quality level between frames, where the driver
+    // is not mid-capture
+    if (stream_level_pending != stream_level) {
+      const StreamLevel &lvl = stream_levels[stream_level_pending];
+      sensor_t *s = esp_camera_sensor_get();
+      if (s != NULL) {
+        s->set_framesize(s, lvl.frame_size);
+        s->set_quality(s, lvl.sensor_quality);
+      }
+      stream_level = stream_level_pending;
+      Serial.printf("Stream quality level -> %d\n", stream_level);
+    }
+#endif
+
+    uint32_t t_capture = stats_now();
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (!fb) {
+      Serial.println("Camera capture failed");
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    stats_record(STAGE_CAPTURE, t_capture);
+#if LOW_LATENCY_CAPTURE
+    capture_account_drops(fb);
+#endif
+
+#if !NATIVE_JPEG_STREAM
+    // Service a pending dataset-tap request from the live pre-JPEG
+    // frame; one extra downscale, only when someone asked
+    if (capture_request) {
+      downscale_to_rgb888(fb->buf, fb->width, fb->height, capture_image);
+      capture_request = false;
+      xSemaphoreGive(capture_done);
+    }
+#endif
+
+    // Offer only every Nth frame to inference (and then only if the
+    // model is ready for one); wait just for the input copy-out, not
+    // for the model itself. All other frames skip straight to encode
+    // with the cached overlay.
+    bool infer_frame = (frame_counter++ % INFERENCE_FRAME_INTERVAL) == 0;
+    if (infer_frame && xQueueSend(infer_queue, &fb, 0) == pdTRUE) {
+      xSemaphoreTake(infer_copied, portMAX_DELAY);
+    }
+
+#if NATIVE_JPEG_STREAM
+    // The frame is already JPEG from the sensor's hardware encoder:
+    // one memcpy into a recycled arena buffer, zero conversion. (No
+    // box overlay in this mode — JPEG frames are not writable.)
+    uint32_t t_encode = stats_now();
+    size_t jpg_len = fb->len;
+    uint8_t *jpg_buf = NULL;
+    if (fb->len <= STREAM_JPEG_BUF_SIZE) {
+      jpg_buf = arena_acquire();
+      if (jpg_buf != NULL) {
+        memcpy(jpg_buf, fb->buf, fb->len);
+        if (jpg_len > arena_frame_len_hw) {
+          arena_frame_len_hw = jpg_len;
+        }
+      }
+    } else {
+      arena_oversize++;
+    }
+    esp_camera_fb_return(fb);
+
+    if (jpg_buf == NULL) {
+      continue; // Every arena buffer held (or oversize frame): drop
+    }
+    stats_record(STAGE_ENCODE, t_encode);
+#else
+    // Encode to JPEG for streaming, straight into a recycled arena
+    // buffer instead of letting fmt2jpg malloc a fresh one
+    uint32_t t_encode = stats_now();
+    JpgEncodeCtx ctx = {};
+    ctx.buf = arena_acquire();
+    if (ctx.buf == NULL) {
+      esp_camera_fb_return(fb);
+      continue; // Every arena buffer held: drop this frame
+    }
+
+    // Compose the most recent completed detection onto the frame for
+    // the encode pass only; restored below so the capture buffer goes
+    // back to the driver untouched. Unannotated frames skip both
+    // passes entirely.
+    taskENTER_CRITICAL(&detection_mux);
+    Detection det = latest_detection;
+    taskEXIT_CRITICAL(&detection_mux);
+
+    bool overlay_drawn = false;
+    if (det.valid) {
+      int x_min = det.box[0] * fb->width;
+      int y_min = det.box[1] * fb->height;
+      int x_max = det.box[2] * fb->width;
+      int y_max = det.box[3] * fb->height;
+      // Green box (RGB565 color: 0x07E0)
+      overlay_drawn = overlay_compose(fb->buf, fb->width, fb->height,
+                                      x_min, y_min, x_max, y_max, 0x07E0);
+    }
+
+#if ADAPTIVE_STREAM
+    int encode_quality = stream_levels[stream_level].encode_quality;
+#else
+    int encode_quality = JPEG_STREAM_QUALITY;
+#endif
+    bool jpeg_converted = fmt2jpg_cb(fb->buf, fb->len, fb->width, fb->height,
+                                     PIXFORMAT_RGB565, encode_quality,
+                                     jpg_arena_write_cb, &ctx);
+    if (overlay_drawn) {
+      overlay_restore(fb->buf, fb->width);
+    }
+    esp_camera_fb_return(fb);
+
+    if (!jpeg_converted || ctx.overflow) {
+      Serial.println("JPEG compression failed");
+      arena_release(ctx.buf);
+      continue;
+    }
+    uint8_t *jpg_buf = ctx.buf;
+    size_t jpg_len = ctx.len;
+    if (jpg_len > arena_frame_len_hw) {
+      arena_frame_len_hw = jpg_len;
+    }
+    stats_record(STAGE_ENCODE, t_encode);
+#endif
+
+    // Publish once; every connected viewer sends from this buffer
+    publish_frame(jpg_buf, jpg_len);
+  }
+}
+
+#if !NATIVE_JPEG_STREAM
+/**
+ * Dirty-region overlay compositor.
+ *
+ * Replaces the old draw_box(), which scattered hundreds of single
+ * uint16_t stores across the PSRAM frame buffer — worst-case access
+ * pattern on the PSRAM bus — and destroyed the clean frame. The
+ * compositor renders each box edge as contiguous row segments: the
+ * pixels a segment will cover are first saved into an internal-RAM
+ * scratch strip, then the segment is written with one memcpy from a
+ * pre-filled color row. overlay_restore() plays the strip back after
+ * encode, so the capture buffer returns to the driver exactly as the
+ * sensor filled it; frames without a detection are never touched.
+ */
+static uint16_t overlay_color_row[OVERLAY_MAX_WIDTH];
+static uint8_t overlay_save[(2 * OVERLAY_MAX_WIDTH + 2 * OVERLAY_MAX_HEIGHT) * 2];
+
+// Dirty region currently composed onto a frame (clamped box), or
+// inactive. Restore replays the same deterministic segment layout the
+// compose pass saved, so no per-segment descriptors are needed.
+static struct {
+  int x_min, y_min, x_max, y_max;
+  bool active;
+} overlay_dirty;
+
+// Compose box edges onto the frame, saving the covered pixels first.
+// Returns false (frame untouched) when the clamped box is empty.
+bool overlay_compose(uint8_t *buf, int width, int height,
+                     int x_min, int y_min, int x_max, int y_max, uint16_t color) {
   x_min = max(0, x_min);
   y_min = max(0, y_min);
   x_max = min(width - 1, x_max);
   y_max = min(height - 1, y_max);
+  if (x_min > x_max || y_min > y_max) {
+    return false;
+  }
 
-  // Draw horizontal lines
-  for (int x = x_min; x <= x_max; x++) {
-    // Top line
-    uint16_t *p_top = (uint16_t *)(buf + (y_min * width + x) * 2);
-    *p_top = color;
-    // Bottom line
-    uint16_t *p_bottom = (uint16_t *)(buf + (y_max * width + x) * 2);
-    *p_bottom = color;
+  int span_bytes = (x_max - x_min + 1) * 2;
+  for (int i = 0; i <= x_max - x_min; i++) {
+    overlay_color_row[i] = color;
   }
-  // Draw vertical lines
-  for (int y = y_min; y <= y_max; y++) {
-    // Left line
-    uint16_t *p_left = (uint16_t *)(buf + (y * width + x_min) * 2);
-    *p_left = color;
-    // Right line
-    uint16_t *p_right = (uint16_t *)(buf + (y * width + x_max) * 2);
-    *p_right = color;
+
+  uint8_t *save = overlay_save;
+  uint8_t *top = buf + (y_min * width + x_min) * 2;
+  uint8_t *bottom = buf + (y_max * width + x_min) * 2;
+
+  // Horizontal edges: one save + one fill memcpy per edge
+  memcpy(save, top, span_bytes);
+  save += span_bytes;
+  memcpy(top, overlay_color_row, span_bytes);
+  memcpy(save, bottom, span_bytes);
+  save += span_bytes;
+  memcpy(bottom, overlay_color_row, span_bytes);
+
+  // Vertical edges: one two-byte segment per side per interior row
+  for (int y = y_min + 1; y < y_max; y++) {
+    uint16_t *row = (uint16_t *)(buf + y * width * 2);
+    memcpy(save, &row[x_min], 2);
+    save += 2;
+    row[x_min] = color;
+    memcpy(save, &row[x_max], 2);
+    save += 2;
+    row[x_max] = color;
   }
+
+  overlay_dirty.x_min = x_min;
+  overlay_dirty.y_min = y_min;
+  overlay_dirty.x_max = x_max;
+  overlay_dirty.y_max = y_max;
+  overlay_dirty.active = true;
+  return true;
 }
 
-// HTTP Handler for Stream
-httpd_handle_t camera_httpd = NULL;
+// Play the scratch strip back, restoring the frame to its pre-compose
+// state. No-op when nothing was composed.
+void overlay_restore(uint8_t *buf, int width) {
+  if (!overlay_dirty.active) {
+    return;
+  }
+  int x_min = overlay_dirty.x_min;
+  int x_max = overlay_dirty.x_max;
+  int span_bytes = (x_max - x_min + 1) * 2;
+
+  const uint8_t *save = overlay_save;
+  memcpy(buf + (overlay_dirty.y_min * width + x_min) * 2, save, span_bytes);
+  save += span_bytes;
+  memcpy(buf + (overlay_dirty.y_max * width + x_min) * 2, save, span_bytes);
+  save += span_bytes;
+
+  for (int y = overlay_dirty.y_min + 1; y < overlay_dirty.y_max; y++) {
+    uint16_t *row = (uint16_t *)(buf + y * width * 2);
+    memcpy(&row[x_min], save, 2);
+    save += 2;
+    memcpy(&row[x_max], save, 2);
+    save += 2;
+  }
+  overlay_dirty.active = false;
+}
+#endif // !NATIVE_JPEG_STREAM
 
+// Push a full buffer down a stream client's socket, looping over the
+// partial sends httpd_socket_send is allowed to make
+static bool stream_send_all(StreamClient &sc, const char *buf, size_t len) {
+    while (len > 0) {
+        int sent = httpd_socket_send(sc.hd, sc.fd, buf, len, 0);
+        if (sent <= 0) {
+            return false;
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+// Per-client stream sender. One of these tasks runs per connected
+// viewer, sending every published frame from the shared buffer down
+// its own socket — a slow viewer delays only itself while the server
+// task stays free to accept more connections and serve /capture and
+// /stats. Exits (and returns its slot) when the socket dies.
+static void stream_sender_task(void *arg) {
+    int slot = (int)(intptr_t)arg;
+    StreamClient &sc = stream_clients[slot];
+    char part[64];
+    uint32_t last_seq = 0;
+    bool ok = true;
+
+    while (ok) {
+        SharedFrame *frame = acquire_frame(last_seq, 1000, slot);
+        if (frame == NULL) {
+            continue; // Pipeline hiccup; keep the connection alive
+        }
+
+        uint32_t t_send = stats_now();
+        ok = stream_send_all(sc, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+        if (ok) {
+            size_t hlen = snprintf(part, sizeof(part), _STREAM_PART, frame->len);
+            ok = stream_send_all(sc, part, hlen);
+        }
+        if (ok) {
+            // Zero-copy: sends straight from the shared buffer
+            ok = stream_send_all(sc, (const char *)frame->buf, frame->len);
+        }
+        stats_record(STAGE_SEND, t_send);
+#if ADAPTIVE_STREAM
+        adapt_record_send((stats_now() - t_send) / STATS_CYCLES_PER_US);
+        adapt_evaluate();
+#endif
+        last_seq = frame->seq;
+        release_frame(frame);
+    }
+
+    // Let httpd reap the session; the fd may already be half-closed
+    httpd_sess_trigger_close(sc.hd, sc.fd);
+    waiter_release(slot);
+    vTaskDelete(NULL);
+}
+
+// HTTP Handler for Stream. Claims a sender slot, writes the multipart
+// response head straight to the socket and hands the connection to a
+// dedicated sender task — the handler itself returns at once, so the
+// server task never blocks behind a viewer.
 httpd_uri_t stream_uri = {
     .uri       = "/stream",
     .method    = HTTP_GET,
     .handler   = [](httpd_req_t *req){
-        esp_err_t res = ESP_OK;
-        char part[64];
-        
-        res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-        if(res != ESP_OK){
-            return res;
+        int slot = waiter_claim();
+        if (slot < 0) {
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            return httpd_resp_send(req, "Too many viewers", HTTPD_RESP_USE_STRLEN);
+        }
+
+        StreamClient &sc = stream_clients[slot];
+        sc.hd = req->handle;
+        sc.fd = httpd_req_to_sockfd(req);
+
+        // Hand-rolled response head: from here on the socket belongs
+        // to the sender task, not httpd's response path
+        static const char head[] =
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: " _STREAM_CONTENT_TYPE "\r\n\r\n";
+        if (!stream_send_all(sc, head, sizeof(head) - 1)) {
+            waiter_release(slot);
+            return ESP_FAIL;
+        }
+
+        char name[16];
+        snprintf(name, sizeof(name), "stream%d", slot);
+        if (xTaskCreatePinnedToCore(stream_sender_task, name, STREAM_TASK_STACK_SIZE,
+                                    (void *)(intptr_t)slot, STREAM_TASK_PRIORITY, NULL,
+                                    STREAM_TASK_CORE) != pdPASS) {
+            waiter_release(slot);
+            return ESP_FAIL;
+        }
+        return ESP_OK;
+    },
+    .user_ctx  = NULL
+};
+
+// GET /capture: dataset tap. Returns the exact 96x96 RGB888 image the
+// model's downscale kernel produces from the current frame, as chunked
+// binary, so training data is collected in tensor space instead of by
+// screenshotting the recompressed stream. Handlers run serialized on
+// the single httpd task, so one tap buffer suffices.
+httpd_uri_t capture_uri = {
+    .uri       = "/capture",
+    .method    = HTTP_GET,
+    .handler   = [](httpd_req_t *req){
+        if (capture_image == NULL) {
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Tap not initialized");
+        }
+#if NATIVE_JPEG_STREAM
+        // Borrow the newest shared JPEG frame and decode it here at
+        // httpd priority; the pipeline never notices the tap
+        SharedFrame *frame = acquire_frame(0, 1000, -1);
+        if (frame == NULL || capture_rgb_buf == NULL) {
+            if (frame != NULL) {
+                release_frame(frame);
+            }
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No frame");
+        }
+        bool decoded = jpg2rgb565(frame->buf, frame->len, capture_rgb_buf, JPG_SCALE_NONE);
+        release_frame(frame);
+        if (!decoded) {
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Decode failed");
         }
 
-        while(true){
-            // Capture frame
-            fb = esp_camera_fb_get();
-            if (!fb) {
-                Serial.println("Camera capture failed");
-                res = ESP_FAIL;
-            } else {
-                // 1. Prepare image for TFLite (Resize 320x240 -> 96x96)
-                // Note: In a production app, use efficient resizing. Here we do a simple center crop/downsample logic conceptually.
-                // For this example, we assume the model input is fed via a pre-processing step.
-                // We will use the fb->buf (RGB565) directly for drawing.
-
-                // 2. Run Detection (Mock logic for structure, actual implementation depends on model output format)
-                // float input[96*96*3]; // Convert RGB565 to RGB888 and flatten here
-                // ml.predict(input);
-                
-                // Example detection logic (Replace with actual TFLite output parsing)
-                // Assuming model returns: confidence, x_min, y_min, x_max, y_max (normalized 0-1)
-                bool cat_detected = false;
-                float score = 0.0;
-                int box[4] = {0};
-
-                // --- PSEUDO-CODE FOR TFLITE INFERENCE ---
-                /*
-                // Convert fb to float input array
-                for(int i=0; i<96*96; i++) {
-                    // ... resize logic ...
-                }
-                
-                if (ml.predict(input)) {
-                    // Get output tensor
-                    float* output = ml.getOutputTensor();
-                    // Parse output for 'cat' class (index 1)
-                    // if (output[1] > 0.6) { ... }
-                }
-                */
-                // ----------------------------------------
-
-                // For demonstration, we will draw a box if we assume a detection
-                // In real use, parse 'box' and 'score' from model output
-                if (cat_detected) {
-                    Serial.printf("Cat detected: %.2f%%\n", score * 100);
-                    int x = box[0] * fb->width;
-                    int y = box[1] * fb->height;
-                    int w = box[2] * fb->width;
-                    int h = box[3] * fb->height;
-                    // Draw Green Box (RGB565 color: 0x07E0)
-                    draw_box(fb->buf, fb->width, fb->height, x, y, x+w, y+h, 0x07E0);
-                }
-
-                // 3. Convert RGB565 back to JPEG for streaming
-                size_t jpg_len = 0;
-                uint8_t *jpg_buf = NULL;
-                bool jpeg_converted = fmt2jpg(fb->buf, fb->len, fb->width, fb->height, PIXFORMAT_RGB565, 80, &jpg_buf, &jpg_len);
-                
-                esp_camera_fb_return(fb);
-                
-                if(!jpeg_converted){
-                    Serial.println("JPEG compression failed");
-                    res = ESP_FAIL;
-                } else {
-                    size_t hlen = snprintf((char *)part, 64, _STREAM_PART, jpg_len);
-                    res = httpd_resp_send_chunk(req, (const char *)part, hlen);
-                    if(res == ESP_OK){
-                        res = httpd_resp_send_chunk(req, (const char *)jpg_buf, jpg_len);
-                    }
-                    free(jpg_buf);
-                }
+        // Frame dimensions follow the adaptive quality level
+        int w = 320, h = 240;
+        sensor_t *s = esp_camera_sensor_get();
+        if (s != NULL && s->status.framesize == FRAMESIZE_QQVGA) {
+            w = 160;
+            h = 120;
+        }
+        downscale_to_rgb888(capture_rgb_buf, w, h, capture_image);
+#else
+        // Ask the capture task to run the kernel on its next pre-JPEG
+        // RGB565 frame
+        capture_request = true;
+        if (xSemaphoreTake(capture_done, pdMS_TO_TICKS(1000)) != pdTRUE) {
+            capture_request = false;
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Capture timed out");
+        }
+#endif
+
+        httpd_resp_set_type(req, "application/octet-stream");
+        httpd_resp_set_hdr(req, "X-Image-Format", "rgb888-96x96");
+        const size_t total = INPUT_WIDTH * INPUT_HEIGHT * 3;
+        for (size_t off = 0; off < total; off += 4096) {
+            size_t n = total - off < 4096 ? total - off : 4096;
+            esp_err_t res = httpd_resp_send_chunk(req, (const char *)capture_image + off, n);
+            if (res != ESP_OK) {
+                return res;
+            }
+        }
+        return httpd_resp_send_chunk(req, NULL, 0);
+    },
+    .user_ctx  = NULL
+};
+
+// GET /stats: per-stage latency aggregates plus pipeline counters as
+// JSON. Stream viewers are served by their own sender tasks, so this
+// stays reachable while units are streaming — which is when it is
+// needed. Reads race the hot path by design; this is a snapshot, not
+// a barrier.
+httpd_uri_t stats_uri = {
+    .uri       = "/stats",
+    .method    = HTTP_GET,
+    .handler   = [](httpd_req_t *req){
+        static char json[1536];
+        int n = 0;
+
+        n += snprintf(json + n, sizeof(json) - n, "{\"stages\":{");
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            StageStats &st = stage_stats[s];
+            uint32_t mean = st.count ? (uint32_t)(st.sum_us / st.count) : 0;
+            n += snprintf(json + n, sizeof(json) - n,
+                          "%s\"%s\":{\"count\":%u,\"mean_us\":%u,\"max_us\":%u,\"hist\":[",
+                          s ? "," : "", stage_names[s], st.count, mean, st.max_us);
+            for (int b = 0; b < STATS_HIST_BUCKETS; b++) {
+                n += snprintf(json + n, sizeof(json) - n, "%s%u",
+                              b ? "," : "", st.hist[b]);
             }
-            if(res != ESP_OK || res == HTTPD_SVC_ERR_STREAM_END){
-                break;
+            n += snprintf(json + n, sizeof(json) - n, "]}");
+        }
+        n += snprintf(json + n, sizeof(json) - n,
+                      "},\"arena\":{\"in_use\":%u,\"in_use_hw\":%u,\"frame_len_hw\":%u,"
+                      "\"exhausted\":%u,\"oversize\":%u}",
+                      jpeg_pool.inUse, jpeg_pool.inUseHighWater, arena_frame_len_hw,
+                      jpeg_pool.exhausted, arena_oversize);
+#if MOTION_GATE
+        n += snprintf(json + n, sizeof(json) - n,
+                      ",\"motion_gate\":{\"runs\":%u,\"skips\":%u}",
+                      motion_gate_runs, motion_gate_skips);
+#endif
+#if ADAPTIVE_STREAM
+        n += snprintf(json + n, sizeof(json) - n,
+                      ",\"adapt\":{\"level\":%d,\"downshifts\":%u,\"upshifts\":%u}",
+                      stream_level, adapt_downshifts, adapt_upshifts);
+#endif
+#if LOW_LATENCY_CAPTURE
+        n += snprintf(json + n, sizeof(json) - n,
+                      ",\"capture\":{\"frame_interval_us\":%u,\"frames_skipped\":%u}",
+                      capture_frame_interval_us, capture_frames_skipped);
+#endif
+#if DETECTION_UPLINK
+        n += snprintf(json + n, sizeof(json) - n,
+                      ",\"uplink\":{\"sent\":%u,\"dropped\":%u}",
+                      uplink_events_sent, uplink_events_dropped);
+#endif
+#if MULTI_MODEL
+        n += snprintf(json + n, sizeof(json) - n,
+                      ",\"models\":{\"active\":\"%s\",\"switches\":%u,"
+                      "\"veto_active\":%s,\"vetoes\":%u,\"slots\":[",
+                      active_slot >= 0 ? model_slots[active_slot].name : "none",
+                      model_switches, reject_veto_active() ? "true" : "false",
+                      reject_vetoes);
+        int listed = 0;
+        for (int i = 0; i < MODEL_SLOT_COUNT; i++) {
+            if (model_slots[i].graph == NULL) {
+                continue;
             }
+            n += snprintf(json + n, sizeof(json) - n,
+                          "%s{\"name\":\"%s\",\"runs\":%u,\"hits\":%u}",
+                          listed++ ? "," : "", model_slots[i].name,
+                          model_slots[i].runs, model_slots[i].hits);
         }
-        return res;
+        n += snprintf(json + n, sizeof(json) - n, "]}");
+#endif
+        n += snprintf(json + n, sizeof(json) - n,
+                      ",\"stream\":{\"published\":%u,\"dropped_no_slot\":%u}}",
+                      publish_seq, frames_dropped_no_slot);
+
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_send(req, json, n);
     },
     .user_ctx  = NULL
 };
@@ -240,6 +2102,9 @@ void startCameraServer(){
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
     config.task_priority = 1; // Lower priority than camera driver
+    // Every viewer holds its socket open for the life of the stream;
+    // leave room for them plus a few control requests
+    config.max_open_sockets = MAX_STREAM_CLIENTS + 3;
 
     httpd_uri_t index_uri = {
         .uri       = "/",
@@ -254,6 +2119,8 @@ void startCameraServer(){
     if (httpd_start(&camera_httpd, &config) == ESP_OK) {
         httpd_register_uri_handler(camera_httpd, &index_uri);
         httpd_register_uri_handler(camera_httpd, &stream_uri);
+        httpd_register_uri_handler(camera_httpd, &capture_uri);
+        httpd_register_uri_handler(camera_httpd, &stats_uri);
         Serial.println("HTTP server started");
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,131 @@
+#include <Arduino.h>
+#include "hp_bench.h"
+#include "hp_ring.h"
+#include "hp_pool.h"
+#include "hp_spsc.h"
+#include "hp_frame.h"
+
+// Iterations per primitive; each iteration is one round trip (write +
+// read, acquire + release, ...) so the cache-warm steady state
+// dominates, which is what the firmwares' hot paths see.
+#define HP_BENCH_ITERATIONS 10000
+
+// 240 MHz core clock
+#define HP_CYCLES_PER_US 240
+
+// Static fixtures, sized like the firmwares size them
+static uint8_t ringStorage[2048];
+static uint8_t poolStorage[4][256];
+static uint8_t *poolBlocks[4];
+static bool poolBusy[4];
+static SpscQueue<uint32_t, 64> spscQueue;
+
+static void benchReport(const char *prim, uint32_t ops,
+                        uint64_t totalCycles, uint32_t worstCycles) {
+  uint32_t totalUs = (uint32_t)(totalCycles / HP_CYCLES_PER_US);
+  uint32_t opsPerSec =
+      totalUs ? (uint32_t)((uint64_t)ops * 1000000 / totalUs) : 0;
+  uint32_t worstNs = (uint32_t)((uint64_t)worstCycles * 1000 / HP_CYCLES_PER_US);
+  Serial.printf("HPBENCH prim=%s ops=%u ops_per_sec=%u worst_ns=%u\n",
+                prim, ops, opsPerSec, worstNs);
+}
+
+void hotpathBenchRun() {
+  uint64_t total;
+  uint32_t worst, t, d;
+
+  Serial.printf("HPBENCH begin iterations=%d\n", HP_BENCH_ITERATIONS);
+
+  // Ring: 64-byte write + read round trip through an empty 2 KB ring
+  RingBuffer ring;
+  ringInit(ring, ringStorage, sizeof(ringStorage));
+  uint8_t chunkIn[64] = {};
+  uint8_t chunkOut[64];
+  total = 0;
+  worst = 0;
+  for (int i = 0; i < HP_BENCH_ITERATIONS; i++) {
+    t = esp_cpu_get_ccount();
+    ringWrite(ring, chunkIn, sizeof(chunkIn));
+    ringRead(ring, chunkOut, sizeof(chunkOut));
+    d = esp_cpu_get_ccount() - t;
+    total += d;
+    if (d > worst) worst = d;
+  }
+  benchReport("ring_write_read_64", HP_BENCH_ITERATIONS, total, worst);
+
+  // Ring: peek + consume, the TX flush pattern
+  ringWrite(ring, chunkIn, sizeof(chunkIn));
+  total = 0;
+  worst = 0;
+  for (int i = 0; i < HP_BENCH_ITERATIONS; i++) {
+    t = esp_cpu_get_ccount();
+    uint16_t peeked = ringPeek(ring, chunkOut, sizeof(chunkOut));
+    ringConsume(ring, peeked);
+    d = esp_cpu_get_ccount() - t;
+    total += d;
+    if (d > worst) worst = d;
+    ringWrite(ring, chunkIn, sizeof(chunkIn)); // Refill outside the timing
+  }
+  benchReport("ring_peek_consume_64", HP_BENCH_ITERATIONS, total, worst);
+
+  // Pool: acquire + release round trip (includes the spinlock)
+  BlockPool pool;
+  for (int i = 0; i < 4; i++) {
+    poolBlocks[i] = poolStorage[i];
+  }
+  poolInit(pool, poolBlocks, poolBusy, 4);
+  total = 0;
+  worst = 0;
+  for (int i = 0; i < HP_BENCH_ITERATIONS; i++) {
+    t = esp_cpu_get_ccount();
+    uint8_t *block = poolAcquire(pool);
+    poolRelease(pool, block);
+    d = esp_cpu_get_ccount() - t;
+    total += d;
+    if (d > worst) worst = d;
+  }
+  benchReport("pool_acquire_release", HP_BENCH_ITERATIONS, total, worst);
+
+  // SPSC queue: push + pop round trip (both sides on this core; the
+  // cross-core case adds cache traffic but no locks)
+  total = 0;
+  worst = 0;
+  for (int i = 0; i < HP_BENCH_ITERATIONS; i++) {
+    uint32_t item;
+    t = esp_cpu_get_ccount();
+    spscQueue.push(i);
+    spscQueue.pop(item);
+    d = esp_cpu_get_ccount() - t;
+    total += d;
+    if (d > worst) worst = d;
+  }
+  benchReport("spsc_push_pop", HP_BENCH_ITERATIONS, total, worst);
+
+  // Frame codec: encode a 32-byte frame and run it back through the
+  // parser byte by byte (the TCP segmentation worst case)
+  uint8_t wire[2 + 32];
+  uint8_t assembly[32];
+  frameEncodeHeader(wire, 32);
+  for (int i = 0; i < 32; i++) {
+    wire[2 + i] = (uint8_t)i;
+  }
+  FrameParser parser;
+  frameParserReset(parser);
+  total = 0;
+  worst = 0;
+  for (int i = 0; i < HP_BENCH_ITERATIONS; i++) {
+    t = esp_cpu_get_ccount();
+    for (size_t j = 0; j < sizeof(wire); j++) {
+      if (frameParserPush(parser, assembly, sizeof(assembly), wire[j]) ==
+          FRAME_COMPLETE) {
+        frameParserReset(parser);
+      }
+    }
+    d = esp_cpu_get_ccount() - t;
+    total += d;
+    if (d > worst) worst = d;
+  }
+  benchReport("frame_encode_parse_32", HP_BENCH_ITERATIONS, total, worst);
+
+  Serial.println("HPBENCH end");
+}
@@ -0,0 +1,18 @@
+/**
+ * hp_bench.h - on-device micro-benchmark for the hotpath primitives.
+ *
+ * Runs each primitive in a tight loop and prints one machine-parseable
+ * line per primitive:
+ *
+ *   HPBENCH prim=<name> ops=<n> ops_per_sec=<n> worst_ns=<n>
+ *
+ * so a library change can be quantified on real silicon before either
+ * firmware picks it up. Built by the esp32dev_hpbench environment.
+ */
+
+#ifndef HP_BENCH_H
+#define HP_BENCH_H
+
+void hotpathBenchRun();
+
+#endif // HP_BENCH_H
@@ -0,0 +1,38 @@
+#include "hp_frame.h"
+
+void frameParserReset(FrameParser &parser) {
+  parser.frameLen = 0;
+  parser.frameGot = 0;
+  parser.lenGot = 0;
+}
+
+FrameParseResult frameParserPush(FrameParser &parser, uint8_t *assembly,
+                                 uint16_t maxPayload, uint8_t b) {
+  if (parser.lenGot < 2) {
+    // Assemble the little-endian uint16 length prefix
+    parser.frameLen |= (uint16_t)b << (8 * parser.lenGot);
+    parser.lenGot++;
+
+    if (parser.lenGot == 2) {
+      if (parser.frameLen > maxPayload) {
+        return FRAME_OVERSIZE;
+      }
+      if (parser.frameLen == 0) {
+        return FRAME_COMPLETE; // Empty frame (keepalive)
+      }
+    }
+    return FRAME_IN_PROGRESS;
+  }
+
+  assembly[parser.frameGot++] = b;
+  if (parser.frameGot == parser.frameLen) {
+    return FRAME_COMPLETE;
+  }
+  return FRAME_IN_PROGRESS;
+}
+
+uint16_t frameEncodeHeader(uint8_t *dst, uint16_t payloadLen) {
+  dst[0] = (uint8_t)(payloadLen & 0xFF);
+  dst[1] = (uint8_t)(payloadLen >> 8);
+  return 2;
+}
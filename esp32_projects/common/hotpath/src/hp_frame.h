@@ -0,0 +1,39 @@
+/**
+ * hp_frame.h - length-prefixed binary frame codec.
+ *
+ * Wire format: [uint16 LE length][payload], as spoken by the espcomms
+ * binary framing mode. The incremental parser assembles one frame at
+ * a time from arbitrarily segmented input (TCP chunks, UART bursts)
+ * into a caller-provided buffer, so a frame may arrive split across
+ * any number of reads.
+ */
+
+#ifndef HP_FRAME_H
+#define HP_FRAME_H
+
+#include <stdint.h>
+
+enum FrameParseResult : uint8_t {
+  FRAME_IN_PROGRESS = 0, // Byte consumed, frame incomplete
+  FRAME_COMPLETE,        // Frame assembled; read frameLen, then reset
+  FRAME_OVERSIZE         // Declared length exceeds the assembly buffer
+};
+
+struct FrameParser {
+  uint16_t frameLen; // Declared length of the frame in flight
+  uint16_t frameGot; // Payload bytes assembled so far
+  uint8_t lenGot;    // Length-prefix bytes assembled so far
+};
+
+void frameParserReset(FrameParser &parser);
+
+// Feed one byte. On FRAME_COMPLETE the assembled payload sits in
+// assembly[0..frameLen); the caller handles it and then resets the
+// parser for the next frame.
+FrameParseResult frameParserPush(FrameParser &parser, uint8_t *assembly,
+                                 uint16_t maxPayload, uint8_t b);
+
+// Write the 2-byte little-endian length prefix; returns bytes written
+uint16_t frameEncodeHeader(uint8_t *dst, uint16_t payloadLen);
+
+#endif // HP_FRAME_H
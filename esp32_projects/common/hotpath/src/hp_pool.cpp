@@ -0,0 +1,47 @@
+#include "hp_pool.h"
+
+void poolInit(BlockPool &pool, uint8_t **blocks, bool *busy, int count) {
+  pool.blocks = blocks;
+  pool.busy = busy;
+  pool.count = count;
+  pool.mux = portMUX_INITIALIZER_UNLOCKED;
+  pool.inUse = 0;
+  pool.inUseHighWater = 0;
+  pool.exhausted = 0;
+  for (int i = 0; i < count; i++) {
+    busy[i] = false;
+  }
+}
+
+uint8_t *poolAcquire(BlockPool &pool) {
+  uint8_t *block = NULL;
+  taskENTER_CRITICAL(&pool.mux);
+  for (int i = 0; i < pool.count; i++) {
+    if (!pool.busy[i]) {
+      pool.busy[i] = true;
+      block = pool.blocks[i];
+      pool.inUse = pool.inUse + 1;
+      if (pool.inUse > pool.inUseHighWater) {
+        pool.inUseHighWater = pool.inUse;
+      }
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&pool.mux);
+  if (block == NULL) {
+    pool.exhausted = pool.exhausted + 1;
+  }
+  return block;
+}
+
+void poolRelease(BlockPool &pool, uint8_t *block) {
+  taskENTER_CRITICAL(&pool.mux);
+  for (int i = 0; i < pool.count; i++) {
+    if (pool.blocks[i] == block) {
+      pool.busy[i] = false;
+      pool.inUse = pool.inUse - 1;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&pool.mux);
+}
@@ -0,0 +1,34 @@
+/**
+ * hp_pool.h - fixed-block pool allocator.
+ *
+ * Hands out caller-provided fixed-size blocks under a spinlock, safe
+ * across tasks and cores. Zero heap traffic after init; exhaustion is
+ * counted, never blocked on, so the caller can drop work instead of
+ * stalling a hot path. Occupancy high-water and exhaustion counters
+ * are kept in the pool for the firmwares' stats endpoints.
+ */
+
+#ifndef HP_POOL_H
+#define HP_POOL_H
+
+#include <Arduino.h>
+
+struct BlockPool {
+  uint8_t **blocks; // Caller-owned array of block pointers
+  bool *busy;       // Caller-owned per-block busy flags
+  int count;
+  portMUX_TYPE mux;
+  volatile uint32_t inUse;
+  volatile uint32_t inUseHighWater; // Most blocks alive at once
+  volatile uint32_t exhausted;      // Acquires that found no free block
+};
+
+void poolInit(BlockPool &pool, uint8_t **blocks, bool *busy, int count);
+
+// Grab a free block, or NULL when every block is still held
+uint8_t *poolAcquire(BlockPool &pool);
+
+// Return a block to the pool
+void poolRelease(BlockPool &pool, uint8_t *block);
+
+#endif // HP_POOL_H
@@ -0,0 +1,62 @@
+#include "hp_ring.h"
+
+void ringInit(RingBuffer &ring, uint8_t *backing, uint16_t size) {
+  ring.data = backing;
+  ring.size = size;
+  ring.head = 0;
+  ring.tail = 0;
+  ring.used = 0;
+  ring.highWater = 0;
+}
+
+uint16_t ringFree(const RingBuffer &ring) {
+  return ring.size - ring.used;
+}
+
+uint16_t ringWrite(RingBuffer &ring, const uint8_t *src, uint16_t len) {
+  uint16_t space = ringFree(ring);
+  if (len > space) {
+    len = space;
+  }
+  for (uint16_t i = 0; i < len; i++) {
+    ring.data[ring.head] = src[i];
+    ring.head = (ring.head + 1) % ring.size;
+  }
+  ring.used += len;
+  if (ring.used > ring.highWater) {
+    ring.highWater = ring.used;
+  }
+  return len;
+}
+
+uint16_t ringRead(RingBuffer &ring, uint8_t *dst, uint16_t len) {
+  if (len > ring.used) {
+    len = ring.used;
+  }
+  for (uint16_t i = 0; i < len; i++) {
+    dst[i] = ring.data[ring.tail];
+    ring.tail = (ring.tail + 1) % ring.size;
+  }
+  ring.used -= len;
+  return len;
+}
+
+uint16_t ringPeek(const RingBuffer &ring, uint8_t *dst, uint16_t len) {
+  if (len > ring.used) {
+    len = ring.used;
+  }
+  uint16_t tail = ring.tail;
+  for (uint16_t i = 0; i < len; i++) {
+    dst[i] = ring.data[tail];
+    tail = (tail + 1) % ring.size;
+  }
+  return len;
+}
+
+void ringConsume(RingBuffer &ring, uint16_t len) {
+  if (len > ring.used) {
+    len = ring.used;
+  }
+  ring.tail = (ring.tail + len) % ring.size;
+  ring.used -= len;
+}
@@ -0,0 +1,42 @@
+/**
+ * hp_ring.h - byte ring buffer over caller-provided static storage.
+ *
+ * Shared hot-path primitive for the esp32_projects firmwares. No
+ * locking and no allocation: the caller owns the backing storage and
+ * serializes access (or wraps calls in a critical section when
+ * producer and consumer live in different tasks).
+ */
+
+#ifndef HP_RING_H
+#define HP_RING_H
+
+#include <stdint.h>
+
+// head is the write index, tail the read index; used/highWater track
+// occupancy so overflow pressure is visible in the field.
+struct RingBuffer {
+  uint8_t *data;
+  uint16_t size;
+  uint16_t head;
+  uint16_t tail;
+  uint16_t used;
+  uint16_t highWater;
+};
+
+void ringInit(RingBuffer &ring, uint8_t *backing, uint16_t size);
+uint16_t ringFree(const RingBuffer &ring);
+
+// Copy up to len bytes in; returns the number actually accepted
+uint16_t ringWrite(RingBuffer &ring, const uint8_t *src, uint16_t len);
+
+// Copy up to len bytes out; returns the number actually read
+uint16_t ringRead(RingBuffer &ring, uint8_t *dst, uint16_t len);
+
+// Copy up to len bytes out without consuming them (for TX flushing,
+// where the socket may accept only part of a chunk)
+uint16_t ringPeek(const RingBuffer &ring, uint8_t *dst, uint16_t len);
+
+// Discard len bytes previously peeked
+void ringConsume(RingBuffer &ring, uint16_t len);
+
+#endif // HP_RING_H
@@ -0,0 +1,59 @@
+/**
+ * hp_spsc.h - lock-free single-producer single-consumer queue.
+ *
+ * Fixed-capacity ring of POD items with exactly one writer task and
+ * one reader task, safe across cores. The indices are C++11 atomics:
+ * the producer publishes head with a release store after writing the
+ * item and the consumer reads it with an acquire load (and vice versa
+ * for tail), so the payload write can never be reordered past the
+ * index publish — plain volatile would order only the index accesses
+ * themselves. For handoffs that need blocking wakeups the firmwares
+ * keep FreeRTOS queues; this is for core-pinned service loops where a
+ * syscall per item would dominate the work.
+ */
+
+#ifndef HP_SPSC_H
+#define HP_SPSC_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint16_t CAPACITY>
+struct SpscQueue {
+  T items[CAPACITY];
+  std::atomic<uint16_t> head{0}; // Written only by the producer
+  std::atomic<uint16_t> tail{0}; // Written only by the consumer
+
+  // Producer side. Returns false (item not queued) when full; one
+  // slot is kept empty to distinguish full from empty.
+  bool push(const T &item) {
+    uint16_t h = head.load(std::memory_order_relaxed);
+    uint16_t next = (uint16_t)((h + 1) % CAPACITY);
+    if (next == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    items[h] = item;
+    head.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when empty.
+  bool pop(T &item) {
+    uint16_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[t];
+    tail.store((uint16_t)((t + 1) % CAPACITY), std::memory_order_release);
+    return true;
+  }
+
+  // Items currently queued (racy snapshot, fine for stats)
+  uint16_t available() const {
+    return (uint16_t)((head.load(std::memory_order_relaxed) + CAPACITY -
+                       tail.load(std::memory_order_relaxed)) %
+                      CAPACITY);
+  }
+};
+
+#endif // HP_SPSC_H
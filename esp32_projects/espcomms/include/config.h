@@ -14,7 +14,98 @@
 // TCP Server Configuration
 #define TCP_PORT 8080
 
+// Size of the fixed per-pass relay buffer. One bulk read of up to this
+// many bytes replaces the old byte-at-a-time echo loop.
+#define RELAY_BUFFER_SIZE 1460
+
+// Binary Framing Configuration
+// A client opts into binary mode by sending these four bytes first
+// thing after connecting. Frames are then [uint16 LE length][payload]
+// with no prompt or newline handling, so raw sensor payloads pass
+// through untouched.
+#define FRAMING_MAGIC_0 0xA5
+#define FRAMING_MAGIC_1 0x5A
+#define FRAMING_MAGIC_2 'B'
+#define FRAMING_MAGIC_3 'F'
+
+// Maximum payload of a single binary frame
+#define FRAME_MAX_PAYLOAD 1024
+
+// Per-client ring buffer size (bytes, one RX and one TX ring each).
+// All rings come from a single compile-time pool so steady-state relay
+// operation performs zero heap allocations.
+#define CLIENT_RING_SIZE 2048
+
+// Pub/Sub Broker Configuration
+// Binary-mode frames start with an opcode byte. ECHO keeps the plain
+// relay behaviour; SUBSCRIBE/UNSUBSCRIBE/PUBLISH drive the broker.
+// Topic IDs are 0..MAX_TOPICS-1 and each client's subscriptions are a
+// bitmask, so the broker state is a single word per connection.
+#define OP_ECHO        0x00
+#define OP_SUBSCRIBE   0x01
+#define OP_UNSUBSCRIBE 0x02
+#define OP_PUBLISH     0x03
+#define OP_STATS       0x04 // Reply with a stats dump frame
+
+// Number of buckets in the loop service-time histogram
+#define STATS_HIST_BUCKETS 8
+
+#define MAX_TOPICS 32
+
+// Benchmark Mode Configuration (compiled in via -DENABLE_BENCHMARK)
+// OP_BENCH_BULK requests a timed bulk transfer: the frame carries a
+// uint32 LE byte count and the hub blasts that many bytes back,
+// reporting bytes/sec over serial. OP_BENCH_ECHO carries a uint16 LE
+// round count; the hub ping-pongs that many small frames, recording
+// per-round RTT and reporting percentiles.
+#define OP_BENCH_BULK 0x10
+#define OP_BENCH_ECHO 0x11
+
+// Cap on recorded RTT samples per echo test
+#define BENCH_MAX_RTT_SAMPLES 256
+
+// Give up on an echo round after this many milliseconds
+#define BENCH_ECHO_TIMEOUT_MS 1000
+
+// ESP-NOW Fast Path Configuration
+// Low-duty-cycle sensors can deliver frames over ESP-NOW (no AP
+// association, no TCP handshake) on the AP channel. Payloads use the
+// same opcode layout as binary TCP frames and feed the same broker.
+#define ESPNOW_QUEUE_DEPTH 8
+#define ESPNOW_MAX_PAYLOAD 250 // ESP-NOW hard limit per frame
+
+// Network Task Configuration
+// The TCP server runs in its own FreeRTOS task pinned to the app core
+// (core 1) so it never competes with the WiFi/LwIP stack on core 0.
+#define NET_TASK_CORE       1
+#define NET_TASK_PRIORITY   3
+#define NET_TASK_STACK_SIZE 8192
+
+// Received-frame queue between the network task and application
+// consumers. Frames larger than RX_FRAME_MAX_PAYLOAD are still relayed
+// in full but only the first RX_FRAME_MAX_PAYLOAD bytes are queued.
+#define RX_QUEUE_DEPTH       8
+#define RX_FRAME_MAX_PAYLOAD 256
+
 // Serial Debug Configuration
 #define SERIAL_BAUD_RATE 115200
 
+// UART Bridge Configuration
+// All hot-path serial output is staged in a ring and drained by a
+// dedicated UART task against the driver's interrupt/DMA-fed FIFO, so
+// a serial burst never back-pressures the TCP path. With
+// UART_BRIDGE_MODE set to 1 the hub becomes a full WiFi<->UART bridge:
+// bytes arriving on the UART are fanned out to connected text-mode
+// clients (and the 's' stats command is disabled, since serial input
+// is then payload).
+#define UART_BRIDGE_MODE 0
+
+#define SERIAL_TX_RING_SIZE 4096
+#define SERIAL_RX_RING_SIZE 1024
+#define SERIAL_HW_BUFFER_SIZE 1024 // UART driver TX/RX buffer
+
+#define UART_TASK_CORE       1
+#define UART_TASK_PRIORITY   2 // Below the network task
+#define UART_TASK_STACK_SIZE 4096
+
 #endif // CONFIG_H
\ No newline at end of file
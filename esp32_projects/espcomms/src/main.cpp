@@ -1,34 +1,236 @@
 /**
  * ESP32 Communications Hub (AP Mode)
- * 
+ *
  * This sketch creates a WiFi Access Point and starts a TCP Server.
  * It allows clients to connect and send messages. The ESP32 acts as a
  * simple relay/echo server to demonstrate communication capabilities.
+ *
+ * Up to MAX_CONNECTIONS clients are serviced concurrently from a
+ * statically allocated pool, so every AP station gets serviced without
+ * waiting for earlier clients to disconnect.
+ *
+ * All socket servicing runs in a dedicated FreeRTOS task pinned to the
+ * app core (core 1), leaving WiFi/LwIP alone on core 0. Received frames
+ * are handed to application consumers through a queue; the Arduino
+ * loop() task is one such consumer.
  */
 
 #include <Arduino.h>
 #include <WiFi.h>
+#include <esp_now.h>
+#include "hp_ring.h"
+#include "hp_frame.h"
+#if HP_BENCH_MODE
+#include "hp_bench.h"
+#endif
 #include "config.h"
 
 // Global server object listening on the defined port
 WiFiServer server(TCP_PORT);
 
-// Current connected client
-WiFiClient currentClient;
+// Statically allocated client pool. One slot per AP station; the AP is
+// configured with the same MAX_CONNECTIONS limit, so a free slot always
+// exists for any station that managed to associate.
+WiFiClient clients[MAX_CONNECTIONS];
+
+// Shared scratch buffer for bulk relay reads. Sized to one TCP segment
+// (RELAY_BUFFER_SIZE) so a full segment moves through in a single
+// read/write pair instead of one byte per loop iteration. Only ever
+// touched from the network task.
+static uint8_t relayBuffer[RELAY_BUFFER_SIZE];
+
+// One received frame as handed from the network task to application
+// consumers. Fixed-size payload so the queue itself never allocates;
+// the network task is the single producer, loop() the single consumer,
+// so xQueueSend/xQueueReceive never contend on a lock in practice.
+struct RxFrame {
+  uint8_t slot;                          // Client pool slot of origin
+  uint16_t len;                          // Valid bytes in data[]
+  uint8_t data[RX_FRAME_MAX_PAYLOAD];
+};
+
+// Queue of received frames (network task -> application)
+static QueueHandle_t rxFrameQueue = NULL;
+
+// Protocol mode of a connection. A client starts out undecided; the
+// first bytes it sends pick the mode (see config.h for the magic).
+enum ClientMode : uint8_t {
+  MODE_NEGOTIATING = 0, // Nothing received yet
+  MODE_TEXT,            // Newline-delimited echo with "> " prompt
+  MODE_BINARY           // Length-prefixed frames, no prompt injection
+};
+
+// Byte rings and the binary framing codec come from the shared
+// hotpath library (esp32_projects/common/hotpath), used by this hub
+// and the camera firmware alike so both hot paths share one tuned
+// implementation.
+
+// Backing storage for every ring: one RX and one TX ring per pool
+// slot, carved from a single static block at init
+static uint8_t ringPool[MAX_CONNECTIONS * 2 * CLIENT_RING_SIZE];
+
+// Per-slot protocol state, statically allocated alongside the client
+// pool. The frame[] assembly buffer lets a binary frame arrive split
+// across any number of TCP segments.
+struct ClientState {
+  ClientMode mode;
+  uint32_t topicMask;                // Bit n set = subscribed to topic n
+  FrameParser parser;                // Length-prefix framing state
+  uint8_t frame[FRAME_MAX_PAYLOAD];
+  RingBuffer rx;                     // Socket -> parser
+  RingBuffer tx;                     // Handlers -> socket
+  uint32_t txDropped;                // Bytes dropped on TX ring overflow
+  uint32_t rxBytes;                  // Total bytes received from socket
+  uint32_t txBytes;                  // Total bytes flushed to socket
+};
+
+static ClientState clientStates[MAX_CONNECTIONS];
+
+// Hub-wide hot-path counters. Plain 32-bit stores are atomic on the
+// ESP32, so incrementing these from the network task and reading them
+// from the dump path needs no locking; volatile keeps the reads
+// honest. The histogram buckets every network-task pass by service
+// time (bounds in statsHistBoundsUs, last bucket is overflow).
+struct HubStats {
+  volatile uint32_t accepted;        // Connections accepted into the pool
+  volatile uint32_t rejected;        // Connections refused (pool full)
+  volatile uint32_t disconnected;    // Connections reaped
+  volatile uint32_t appQueueDrops;   // Frames dropped on full RX queue
+  volatile uint32_t espNowRx;        // ESP-NOW frames received
+  volatile uint32_t espNowDrops;     // ESP-NOW frames dropped (queue full)
+  volatile uint32_t passHist[STATS_HIST_BUCKETS];
+};
+
+static HubStats hubStats;
+
+static const uint32_t statsHistBoundsUs[STATS_HIST_BUCKETS - 1] = {
+  50, 100, 200, 500, 1000, 5000, 20000
+};
+
+// Bucket one network-task pass; a handful of cycles on the hot path
+inline void statsRecordPass(uint32_t us) {
+  int b = 0;
+  while (b < STATS_HIST_BUCKETS - 1 && us >= statsHistBoundsUs[b]) {
+    b++;
+  }
+  hubStats.passHist[b] = hubStats.passHist[b] + 1;
+}
+
+// Serial bridge rings. The network task produces into the TX ring and
+// the UART task consumes it (and the reverse for RX), so each ring is
+// guarded by a spinlock around the short index updates.
+static uint8_t serialTxRingBuf[SERIAL_TX_RING_SIZE];
+static uint8_t serialRxRingBuf[SERIAL_RX_RING_SIZE];
+static RingBuffer serialTxRing;
+static RingBuffer serialRxRing;
+static portMUX_TYPE serialTxMux = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE serialRxMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t serialTxDrops = 0; // Bytes lost to a full TX ring
+
+// Handle of the UART servicing task
+static TaskHandle_t uartTaskHandle = NULL;
+
+// Stage bytes for the serial port without ever blocking the caller.
+// Overflow drops the excess and counts it — a stalled UART must never
+// stall the network task.
+void serialBridgeWrite(const uint8_t *data, uint16_t len) {
+  taskENTER_CRITICAL(&serialTxMux);
+  uint16_t accepted = ringWrite(serialTxRing, data, len);
+  taskEXIT_CRITICAL(&serialTxMux);
+  if (accepted < len) {
+    serialTxDrops = serialTxDrops + (len - accepted);
+  }
+  if (uartTaskHandle != NULL) {
+    xTaskNotifyGive(uartTaskHandle); // Wake the drain immediately
+  }
+}
+
+// Hot-path log line, staged through the serial TX ring instead of
+// Serial.printf — which blocks once the 1 KB driver buffer fills and
+// would hand the relay's throughput back to the 115200-baud UART. A
+// slow monitor drops log bytes (counted in serialTxDrops), never relay
+// frames. In bridge mode serial bytes are payload, so per-frame chatter
+// is suppressed entirely.
+static void serialLogf(const char *fmt, ...) {
+#if !UART_BRIDGE_MODE
+  char line[128];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (n > 0) {
+    if (n > (int)sizeof(line) - 1) {
+      n = sizeof(line) - 1;
+    }
+    serialBridgeWrite((const uint8_t *)line, (uint16_t)n);
+  }
+#endif
+}
+
+// Handle of the network servicing task pinned to NET_TASK_CORE
+static TaskHandle_t netTaskHandle = NULL;
+
+// One frame received over ESP-NOW, queued out of the receive callback
+// (which runs in the WiFi task) for servicing on the network task.
+struct EspNowFrame {
+  uint8_t mac[6];                     // Sender MAC, for echo replies
+  uint8_t len;                        // Valid bytes in data[]
+  uint8_t data[ESPNOW_MAX_PAYLOAD];
+};
+
+// Queue of ESP-NOW frames (WiFi task callback -> network task)
+static QueueHandle_t espNowQueue = NULL;
+
+// Sentinel slot for frames that did not arrive over TCP
+#define SLOT_ESPNOW -1
+
+// Function prototypes
+void acceptClients();
+void dumpStats();
+void resetClientState(int slot);
+void clientSend(int slot, const uint8_t *data, uint16_t len);
+size_t flushClientTx(int slot);
+void queueRxFrame(int slot, const uint8_t *data, size_t len);
+void handleTextChunk(int slot, const uint8_t *data, size_t len);
+void sendBinaryFrame(int slot, const uint8_t *payload, uint16_t len);
+void handleBinaryChunk(int slot, const uint8_t *data, size_t len);
+void publishToTopic(int fromSlot, uint8_t topic, const uint8_t *frame, uint16_t len);
+void dispatchFrame(int slot, const uint8_t *frame, uint16_t len);
+void negotiateMode(int slot);
+size_t serviceClient(int slot);
+void onEspNowRecv(const uint8_t *mac, const uint8_t *data, int len);
+size_t serviceEspNow();
+void uartTask(void *arg);
+#if UART_BRIDGE_MODE
+size_t bridgeSerialToClients();
+#endif
+void networkTask(void *arg);
 
 void setup() {
-  // Initialize Serial communication for debugging
+  // Initialize Serial communication for debugging. Enlarged driver
+  // buffers (set before begin) keep Serial.write from the UART task
+  // non-blocking; the driver moves bytes to the FIFO from interrupt
+  // context.
+  Serial.setTxBufferSize(SERIAL_HW_BUFFER_SIZE);
+  Serial.setRxBufferSize(SERIAL_HW_BUFFER_SIZE);
   Serial.begin(SERIAL_BAUD_RATE);
   while (!Serial) {
     ; // Wait for serial port to connect (needed for some USB-serial adapters)
   }
-  
+
   delay(1000);
+
+#if HP_BENCH_MODE
+  // Benchmark build: measure the shared hotpath primitives and idle —
+  // the hub itself never starts
+  hotpathBenchRun();
+  return;
+#endif
   Serial.println("\n--- ESP32 Comms Hub Starting ---");
 
   // 1. Configure Access Point
   Serial.print("Setting up AP (Access Point)...");
-  
+
   // We explicitly set the mode to AP to ensure it doesn't try to connect to a router
   WiFi.mode(WIFI_AP);
 
@@ -59,55 +261,779 @@ void setup() {
   // 3. Start TCP Server
   server.begin();
   server.setNoDelay(true); // Disable Nagle's algorithm for faster small packet transmission
-  
+
   Serial.println("TCP Server started on port " + String(TCP_PORT));
+
+  // 4. Start the ESP-NOW fast path on the same channel as the AP.
+  // Battery nodes can deliver a frame in tens of milliseconds without
+  // associating, instead of paying seconds of radio-on time for a full
+  // WiFi + TCP round trip.
+  espNowQueue = xQueueCreate(ESPNOW_QUEUE_DEPTH, sizeof(EspNowFrame));
+  if (espNowQueue == NULL || esp_now_init() != ESP_OK) {
+    Serial.println("ESP-NOW init failed; fast path disabled.");
+  } else {
+    esp_now_register_recv_cb(onEspNowRecv);
+    Serial.printf("ESP-NOW fast path listening on channel %d.\n", AP_CHANNEL);
+  }
+
+  // 5. Start the network servicing task on the app core
+  rxFrameQueue = xQueueCreate(RX_QUEUE_DEPTH, sizeof(RxFrame));
+  if (rxFrameQueue == NULL) {
+    Serial.println("Unable to create RX frame queue. Halting execution.");
+    while (1) {
+      delay(1000); // Halt on error
+    }
+  }
+
+  // The serial bridge rings must exist before either task can run
+  ringInit(serialTxRing, serialTxRingBuf, SERIAL_TX_RING_SIZE);
+  ringInit(serialRxRing, serialRxRingBuf, SERIAL_RX_RING_SIZE);
+
+  xTaskCreatePinnedToCore(networkTask, "net", NET_TASK_STACK_SIZE, NULL,
+                          NET_TASK_PRIORITY, &netTaskHandle, NET_TASK_CORE);
+
+  // 6. Start the UART servicing task behind the serial bridge rings
+  xTaskCreatePinnedToCore(uartTask, "uart", UART_TASK_STACK_SIZE, NULL,
+                          UART_TASK_PRIORITY, &uartTaskHandle, UART_TASK_CORE);
+
+  Serial.printf("Network task started on core %d.\n", NET_TASK_CORE);
+#if UART_BRIDGE_MODE
+  Serial.println("UART bridge mode active: serial traffic is relayed to clients.");
+#endif
   Serial.println("Waiting for clients...");
 }
 
-void loop() {
-  // Check for new client connections if we don't have one
-  if (!currentClient || !currentClient.connected()) {
-    if (currentClient) {
-      // Clean up disconnected client
-      currentClient.stop();
-      Serial.println("Client disconnected.");
-    }
-
-    // Attempt to accept a new connection
-    currentClient = server.available();
-    
-    if (currentClient) {
-      Serial.println("New client connected!");
+// Accept a pending connection into a free pool slot, if any.
+// Non-blocking: server.available() returns an invalid client when
+// nothing is pending.
+void acceptClients() {
+  WiFiClient incoming = server.available();
+  if (!incoming) {
+    return;
+  }
+
+  for (int i = 0; i < MAX_CONNECTIONS; i++) {
+    if (!clients[i] || !clients[i].connected()) {
+      // Reclaim the slot if it still holds a dead connection
+      if (clients[i]) {
+        clients[i].stop();
+      }
+      clients[i] = incoming;
+      resetClientState(i);
+      hubStats.accepted = hubStats.accepted + 1;
+
+      Serial.printf("New client connected in slot %d!\n", i);
       Serial.print("Client IP: ");
-      Serial.println(currentClient.remoteIP());
-      
-      // Send a welcome message to the client
-      currentClient.println("Welcome to ESP32 Comms Hub.");
-      currentClient.println("Send a message and it will be echoed back.");
-      currentClient.println("> "); 
-    }
-  }
-
-  // Handle data from connected client
-  if (currentClient && currentClient.connected()) {
-    if (currentClient.available()) {
-      // Read incoming byte
-      char c = currentClient.read();
-      
-      // Echo to Serial Monitor for debugging
-      Serial.write(c);
-
-      // Echo back to the client (Loopback)
-      currentClient.write(c);
-
-      // If newline is received, send prompt again
-      if (c == '\n') {
-        currentClient.print("> ");
+      Serial.println(clients[i].remoteIP());
+
+      // The welcome banner is deferred until the client's first bytes
+      // pick the protocol mode; a binary client must never see prompt
+      // text mixed into its stream.
+      return;
+    }
+  }
+
+  // Pool exhausted (should not happen while the AP caps stations at
+  // MAX_CONNECTIONS, but guard against it anyway)
+  hubStats.rejected = hubStats.rejected + 1;
+  Serial.println("Connection rejected: client pool full.");
+  incoming.println("Server full, try again later.");
+  incoming.stop();
+}
+
+// Dump every counter the hub keeps to the serial monitor: global
+// accept/drop counts, queue depths, the loop service-time histogram
+// and per-client byte/ring figures. Reads are racy against the hot
+// path by design — this is a snapshot, not a barrier.
+void dumpStats() {
+  Serial.println("--- Hub Statistics ---");
+  Serial.printf("accepted=%u rejected=%u disconnected=%u\n",
+                hubStats.accepted, hubStats.rejected, hubStats.disconnected);
+  Serial.printf("app_queue_depth=%u app_queue_drops=%u\n",
+                (unsigned)uxQueueMessagesWaiting(rxFrameQueue), hubStats.appQueueDrops);
+  Serial.printf("espnow_rx=%u espnow_drops=%u espnow_queue_depth=%u\n",
+                hubStats.espNowRx, hubStats.espNowDrops,
+                espNowQueue ? (unsigned)uxQueueMessagesWaiting(espNowQueue) : 0);
+  Serial.printf("serial_tx_ring=%u/%u(hw %u) serial_tx_drops=%u\n",
+                serialTxRing.used, serialTxRing.size, serialTxRing.highWater,
+                serialTxDrops);
+
+  Serial.print("loop_pass_hist_us:");
+  for (int b = 0; b < STATS_HIST_BUCKETS; b++) {
+    if (b < STATS_HIST_BUCKETS - 1) {
+      Serial.printf(" <%u=%u", statsHistBoundsUs[b], hubStats.passHist[b]);
+    } else {
+      Serial.printf(" rest=%u", hubStats.passHist[b]);
+    }
+  }
+  Serial.println();
+
+  for (int i = 0; i < MAX_CONNECTIONS; i++) {
+    if (!clients[i] || !clients[i].connected()) {
+      continue;
+    }
+    ClientState &state = clientStates[i];
+    Serial.printf("slot %d: mode=%d rx_bytes=%u tx_bytes=%u "
+                  "rx_ring=%u/%u(hw %u) tx_ring=%u/%u(hw %u) tx_dropped=%u topics=0x%08X\n",
+                  i, state.mode, state.rxBytes, state.txBytes,
+                  state.rx.used, state.rx.size, state.rx.highWater,
+                  state.tx.used, state.tx.size, state.tx.highWater,
+                  state.txDropped, state.topicMask);
+  }
+  Serial.println("----------------------");
+}
+
+// Reset a pool slot for a fresh connection: wipe protocol state and
+// rebind the RX/TX rings to this slot's region of the static pool.
+void resetClientState(int slot) {
+  ClientState &state = clientStates[slot];
+  memset(&state, 0, sizeof(state));
+  state.mode = MODE_NEGOTIATING;
+  ringInit(state.rx, &ringPool[(slot * 2) * CLIENT_RING_SIZE], CLIENT_RING_SIZE);
+  ringInit(state.tx, &ringPool[(slot * 2 + 1) * CLIENT_RING_SIZE], CLIENT_RING_SIZE);
+}
+
+// Stage outgoing bytes in the slot's TX ring. Overflow (a client too
+// slow to drain its socket) drops the excess and counts it rather than
+// blocking the network task.
+void clientSend(int slot, const uint8_t *data, uint16_t len) {
+  ClientState &state = clientStates[slot];
+  uint16_t accepted = ringWrite(state.tx, data, len);
+  if (accepted < len) {
+    state.txDropped += len - accepted;
+  }
+}
+
+// Push staged TX bytes to the socket, consuming only what the socket
+// actually accepted so a partial write loses nothing. Returns bytes
+// flushed.
+size_t flushClientTx(int slot) {
+  WiFiClient &client = clients[slot];
+  ClientState &state = clientStates[slot];
+  size_t flushed = 0;
+
+  while (state.tx.used > 0 && client.connected()) {
+    uint8_t chunk[256];
+    uint16_t peeked = ringPeek(state.tx, chunk, sizeof(chunk));
+    size_t written = client.write(chunk, peeked);
+    ringConsume(state.tx, (uint16_t)written);
+    flushed += written;
+    if (written < peeked) {
+      break; // Socket buffer full; retry next pass
+    }
+  }
+  return flushed;
+}
+
+// Hand a copy of received data to application consumers. If the queue
+// is full we drop the application copy rather than stall the relay
+// path.
+void queueRxFrame(int slot, const uint8_t *data, size_t len) {
+  RxFrame frame;
+  frame.slot = (uint8_t)slot;
+  frame.len = (len > RX_FRAME_MAX_PAYLOAD) ? RX_FRAME_MAX_PAYLOAD : (uint16_t)len;
+  memcpy(frame.data, data, frame.len);
+  if (xQueueSend(rxFrameQueue, &frame, 0) != pdTRUE) {
+    hubStats.appQueueDrops = hubStats.appQueueDrops + 1;
+    Serial.println("RX queue full, application frame dropped.");
+  }
+}
+
+// Text-mode handler: echo the chunk, mirror it to the serial monitor
+// and keep the interactive prompt behaviour.
+void handleTextChunk(int slot, const uint8_t *data, size_t len) {
+  // Mirror to the serial port through the bridge ring; never blocks
+  // the relay path even when the UART is saturated
+  serialBridgeWrite(data, len);
+
+  // Echo back to the client (staged in the TX ring, flushed each pass)
+  clientSend(slot, data, len);
+
+  // Re-send the prompt once if the chunk contained any newline
+  if (memchr(data, '\n', len) != NULL) {
+    clientSend(slot, (const uint8_t *)"> ", 2);
+  }
+
+  queueRxFrame(slot, data, len);
+}
+
+// Stage one length-prefixed frame for a binary-mode client
+void sendBinaryFrame(int slot, const uint8_t *payload, uint16_t len) {
+  uint8_t prefix[2];
+  frameEncodeHeader(prefix, len);
+  clientSend(slot, prefix, sizeof(prefix));
+  clientSend(slot, payload, len);
+}
+
+// Binary-mode handler: run the chunk through the framing parser and
+// echo each completed frame back untouched, with its length prefix and
+// nothing else. Payload bytes are never scanned or modified.
+void handleBinaryChunk(int slot, const uint8_t *data, size_t len) {
+  WiFiClient &client = clients[slot];
+  ClientState &state = clientStates[slot];
+
+  for (size_t i = 0; i < len; i++) {
+    FrameParseResult res =
+        frameParserPush(state.parser, state.frame, FRAME_MAX_PAYLOAD, data[i]);
+
+    if (res == FRAME_OVERSIZE) {
+      Serial.printf("Slot %d: oversized frame (%u bytes), dropping client.\n",
+                    slot, state.parser.frameLen);
+      client.stop();
+      return;
+    }
+    if (res == FRAME_COMPLETE) {
+      // Frame complete: dispatch it and reset the parser
+      dispatchFrame(slot, state.frame, state.parser.frameLen);
+      frameParserReset(state.parser);
+    }
+  }
+}
+
+// Fan a published message out to every subscriber of its topic. All
+// subscribers are written straight from the publisher's assembly
+// buffer — one shared copy of the message regardless of subscriber
+// count. The publisher itself does not get its own message back.
+void publishToTopic(int fromSlot, uint8_t topic, const uint8_t *frame, uint16_t len) {
+  uint32_t bit = 1UL << topic;
+  int delivered = 0;
+
+  for (int i = 0; i < MAX_CONNECTIONS; i++) {
+    if (i == fromSlot) {
+      continue;
+    }
+    if (!clients[i] || !clients[i].connected()) {
+      continue;
+    }
+    if (clientStates[i].mode != MODE_BINARY || !(clientStates[i].topicMask & bit)) {
+      continue;
+    }
+    sendBinaryFrame(i, frame, len);
+    delivered++;
+  }
+
+  serialLogf("Slot %d: published %u bytes on topic %u to %d subscriber(s).\n",
+             fromSlot, (unsigned)(len - 2), topic, delivered);
+}
+
+#ifdef ENABLE_BENCHMARK
+// --- Benchmark mode -------------------------------------------------
+// Compiled in via -DENABLE_BENCHMARK in platformio.ini. Clients request
+// tests with the OP_BENCH_* opcodes; results go to the serial monitor
+// in a fixed "BENCH ..." format so a rack script can parse them.
+
+// Benchmark scratch. The bench opcodes run from dispatchFrame while
+// handleBinaryChunk is still iterating relayBuffer (the dispatched
+// chunk *is* relayBuffer), so the benchmarks must not scribble over
+// it — a client pipelining another frame behind a bench request would
+// have the rest of its chunk corrupted mid-parse.
+static uint8_t benchBuffer[RELAY_BUFFER_SIZE];
+
+// Per-pass service time of the network task, recorded every iteration
+static uint32_t benchPassCount = 0;
+static uint64_t benchPassSumUs = 0;
+static uint32_t benchPassMaxUs = 0;
+
+void benchRecordPass(uint32_t us) {
+  benchPassCount++;
+  benchPassSumUs += us;
+  if (us > benchPassMaxUs) {
+    benchPassMaxUs = us;
+  }
+}
+
+void benchReportPassStats() {
+  if (benchPassCount == 0) {
+    return;
+  }
+  Serial.printf("BENCH loop passes=%u avg_us=%llu max_us=%u\n",
+                benchPassCount,
+                benchPassSumUs / benchPassCount,
+                benchPassMaxUs);
+  benchPassCount = 0;
+  benchPassSumUs = 0;
+  benchPassMaxUs = 0;
+}
+
+int benchCompareU32(const void *a, const void *b) {
+  uint32_t ua = *(const uint32_t *)a;
+  uint32_t ub = *(const uint32_t *)b;
+  return (ua > ub) - (ua < ub);
+}
+
+// Timed bulk transfer: blast totalBytes of pattern data at the client
+// in RELAY_BUFFER_SIZE chunks and report achieved throughput.
+void runBulkBenchmark(int slot, uint32_t totalBytes) {
+  WiFiClient &client = clients[slot];
+
+  Serial.printf("BENCH bulk start slot=%d bytes=%u\n", slot, totalBytes);
+  memset(benchBuffer, 0x55, sizeof(benchBuffer));
+
+  uint32_t startUs = micros();
+  uint32_t remaining = totalBytes;
+  while (remaining > 0 && client.connected()) {
+    size_t chunk = (remaining > sizeof(benchBuffer)) ? sizeof(benchBuffer) : remaining;
+    size_t sent = client.write(benchBuffer, chunk);
+    if (sent == 0) {
+      break; // Socket error or client gone
+    }
+    remaining -= sent;
+  }
+  uint32_t elapsedUs = micros() - startUs;
+  uint32_t sentBytes = totalBytes - remaining;
+
+  Serial.printf("BENCH bulk done slot=%d bytes=%u elapsed_us=%u bytes_per_sec=%u\n",
+                slot, sentBytes, elapsedUs,
+                (elapsedUs > 0) ? (uint32_t)((uint64_t)sentBytes * 1000000 / elapsedUs) : 0);
+  benchReportPassStats();
+}
+
+// Echo round-trip test: ping-pong `rounds` small frames with the
+// client (which must loop every received byte straight back) and
+// report RTT percentiles.
+void runEchoBenchmark(int slot, uint16_t rounds) {
+  WiFiClient &client = clients[slot];
+  static uint32_t samples[BENCH_MAX_RTT_SAMPLES];
+
+  if (rounds > BENCH_MAX_RTT_SAMPLES) {
+    rounds = BENCH_MAX_RTT_SAMPLES;
+  }
+  Serial.printf("BENCH echo start slot=%d rounds=%u\n", slot, rounds);
+
+  uint8_t ping[16];
+  memset(ping, 0xAA, sizeof(ping));
+
+  uint16_t completed = 0;
+  for (uint16_t r = 0; r < rounds && client.connected(); r++) {
+    uint32_t startUs = micros();
+    client.write(ping, sizeof(ping));
+
+    // Wait for the full ping to come back. The idle wait yields a
+    // tick: this runs on the network task at priority 3, and spinning
+    // on available() would starve the UART task and loop() for the
+    // whole echo timeout, overflowing the TX ring and rxFrameQueue.
+    size_t got = 0;
+    uint32_t deadline = millis() + BENCH_ECHO_TIMEOUT_MS;
+    while (got < sizeof(ping) && millis() < deadline) {
+      if (client.available()) {
+        int n = client.read(benchBuffer, sizeof(ping) - got);
+        if (n > 0) {
+          got += n;
+        }
+      } else {
+        vTaskDelay(1);
+      }
+    }
+    if (got < sizeof(ping)) {
+      Serial.printf("BENCH echo timeout slot=%d round=%u\n", slot, r);
+      break;
+    }
+    samples[completed++] = micros() - startUs;
+  }
+
+  if (completed > 0) {
+    qsort(samples, completed, sizeof(samples[0]), benchCompareU32);
+    Serial.printf("BENCH echo done slot=%d rounds=%u p50_us=%u p95_us=%u p99_us=%u max_us=%u\n",
+                  slot, completed,
+                  samples[completed / 2],
+                  samples[(uint32_t)completed * 95 / 100],
+                  samples[(uint32_t)completed * 99 / 100],
+                  samples[completed - 1]);
+  }
+  benchReportPassStats();
+}
+#endif // ENABLE_BENCHMARK
+
+// Dispatch one complete binary frame. The first payload byte is the
+// opcode; OP_ECHO keeps the original relay behaviour, the rest drive
+// the broker. Malformed frames are logged and dropped.
+void dispatchFrame(int slot, const uint8_t *frame, uint16_t len) {
+  ClientState &state = clientStates[slot];
+
+  if (len == 0) {
+    return;
+  }
+
+  uint8_t op = frame[0];
+
+  if (op == OP_ECHO) {
+    sendBinaryFrame(slot, frame, len);
+    queueRxFrame(slot, frame, len);
+    serialLogf("Slot %d: relayed %u-byte frame.\n", slot, len);
+    return;
+  }
+
+#ifdef ENABLE_BENCHMARK
+  if (op == OP_BENCH_BULK && len >= 5) {
+    uint32_t totalBytes = (uint32_t)frame[1] | ((uint32_t)frame[2] << 8) |
+                          ((uint32_t)frame[3] << 16) | ((uint32_t)frame[4] << 24);
+    runBulkBenchmark(slot, totalBytes);
+    return;
+  }
+  if (op == OP_BENCH_ECHO && len >= 3) {
+    uint16_t rounds = (uint16_t)frame[1] | ((uint16_t)frame[2] << 8);
+    runEchoBenchmark(slot, rounds);
+    return;
+  }
+#endif
+
+  if (op == OP_STATS) {
+    // Reply with a compact text summary in a single frame; the full
+    // dump (per-client detail) stays on the serial monitor
+    char summary[160];
+    int n = snprintf(summary, sizeof(summary),
+                     "accepted=%u rejected=%u disconnected=%u "
+                     "app_drops=%u espnow_rx=%u espnow_drops=%u",
+                     hubStats.accepted, hubStats.rejected, hubStats.disconnected,
+                     hubStats.appQueueDrops, hubStats.espNowRx, hubStats.espNowDrops);
+    sendBinaryFrame(slot, (const uint8_t *)summary, (uint16_t)n);
+    return;
+  }
+
+  // All broker opcodes carry a topic byte after the opcode
+  if (len < 2 || frame[1] >= MAX_TOPICS) {
+    Serial.printf("Slot %d: malformed broker frame (op 0x%02X, len %u), dropped.\n",
+                  slot, op, len);
+    return;
+  }
+  uint8_t topic = frame[1];
+
+  switch (op) {
+    case OP_SUBSCRIBE:
+      state.topicMask |= 1UL << topic;
+      Serial.printf("Slot %d: subscribed to topic %u.\n", slot, topic);
+      break;
+    case OP_UNSUBSCRIBE:
+      state.topicMask &= ~(1UL << topic);
+      Serial.printf("Slot %d: unsubscribed from topic %u.\n", slot, topic);
+      break;
+    case OP_PUBLISH:
+      // Subscribers receive the frame exactly as published
+      // ([OP_PUBLISH][topic][payload]), so one node's publish replaces
+      // every listener polling for the same reading
+      publishToTopic(slot, topic, frame, len);
+      queueRxFrame(slot, frame, len);
+      break;
+    default:
+      Serial.printf("Slot %d: unknown opcode 0x%02X, frame dropped.\n", slot, op);
+      break;
+  }
+}
+
+// Resolve the protocol mode from the first bytes a client sends. The
+// bytes are peeked from the RX ring, not consumed: a binary client's
+// 4-byte magic can arrive split across TCP segments (a no-delay client
+// issuing small writes), so the decision waits until either the full
+// magic is buffered or an earlier byte already rules it out. On a
+// mismatch the buffered bytes stay ringed for the text path to drain
+// this same pass; on a match only the magic itself is consumed.
+void negotiateMode(int slot) {
+  WiFiClient &client = clients[slot];
+  ClientState &state = clientStates[slot];
+
+  static const uint8_t magic[4] = {
+    FRAMING_MAGIC_0, FRAMING_MAGIC_1, FRAMING_MAGIC_2, FRAMING_MAGIC_3
+  };
+
+  uint8_t head[sizeof(magic)];
+  uint16_t avail = ringPeek(state.rx, head, sizeof(head));
+  if (avail == 0) {
+    return;
+  }
+
+  if (memcmp(head, magic, avail < sizeof(magic) ? avail : sizeof(magic)) != 0) {
+    // Some byte already rules the magic out: a text client. Greet it;
+    // its buffered bytes go through the normal text path.
+    state.mode = MODE_TEXT;
+    client.println("Welcome to ESP32 Comms Hub.");
+    client.println("Send a message and it will be echoed back.");
+    client.print("> ");
+    return;
+  }
+  if (avail < sizeof(magic)) {
+    return; // Matching prefix so far; wait for the rest of the magic
+  }
+
+  ringConsume(state.rx, sizeof(magic));
+  state.mode = MODE_BINARY;
+  Serial.printf("Slot %d: binary framing mode negotiated.\n", slot);
+}
+
+// Service a single client slot: reap it if disconnected, otherwise
+// bulk-relay any pending data. Returns the number of bytes moved so the
+// caller can tell a busy pass from an idle one.
+size_t serviceClient(int slot) {
+  WiFiClient &client = clients[slot];
+  ClientState &state = clientStates[slot];
+
+  if (!client) {
+    return 0;
+  }
+
+  if (!client.connected()) {
+    client.stop();
+    hubStats.disconnected = hubStats.disconnected + 1;
+    Serial.printf("Client in slot %d disconnected. "
+                  "Ring high-water: rx=%u tx=%u, tx dropped=%u bytes.\n",
+                  slot, state.rx.highWater, state.tx.highWater, state.txDropped);
+    return 0;
+  }
+
+  size_t moved = 0;
+
+  // Pull socket data into the slot's RX ring. The read is capped by
+  // ring space, so a parser stall backpressures into the TCP window
+  // instead of losing bytes.
+  size_t pending = client.available();
+  uint16_t space = ringFree(state.rx);
+  if (pending > space) {
+    pending = space;
+  }
+  if (pending > sizeof(relayBuffer)) {
+    pending = sizeof(relayBuffer);
+  }
+  if (pending > 0) {
+    size_t len = client.readBytes(relayBuffer, pending);
+    if (len > 0) {
+      ringWrite(state.rx, relayBuffer, (uint16_t)len);
+      state.rxBytes += len;
+      moved += len;
+    }
+  }
+
+  // Resolve the protocol mode first. Undecided bytes stay in the RX
+  // ring — negotiateMode peeks rather than consumes, so a magic split
+  // across segments still negotiates binary once the rest arrives.
+  if (state.mode == MODE_NEGOTIATING) {
+    negotiateMode(slot);
+  }
+
+  // Drain the RX ring through the protocol handler
+  if (state.mode != MODE_NEGOTIATING) {
+    uint16_t chunk = ringRead(state.rx, relayBuffer, sizeof(relayBuffer));
+    if (chunk > 0) {
+      switch (state.mode) {
+        case MODE_TEXT:
+          handleTextChunk(slot, relayBuffer, chunk);
+          break;
+        case MODE_BINARY:
+          handleBinaryChunk(slot, relayBuffer, chunk);
+          break;
+        default:
+          break;
       }
     }
   }
 
-  // Small delay to prevent watchdog triggering in heavy load scenarios
-  // (though typically not needed with yield() inside WiFi libs)
-  delay(10); 
-}
\ No newline at end of file
+  // Push whatever the handlers staged back out
+  size_t flushed = flushClientTx(slot);
+  state.txBytes += flushed;
+  moved += flushed;
+
+  return moved;
+}
+
+// ESP-NOW receive callback. Runs in the WiFi task, so it only copies
+// the frame into the queue; all real work happens on the network task.
+void onEspNowRecv(const uint8_t *mac, const uint8_t *data, int len) {
+  if (len <= 0 || len > ESPNOW_MAX_PAYLOAD) {
+    return;
+  }
+
+  hubStats.espNowRx = hubStats.espNowRx + 1;
+
+  EspNowFrame frame;
+  memcpy(frame.mac, mac, sizeof(frame.mac));
+  frame.len = (uint8_t)len;
+  memcpy(frame.data, data, len);
+  if (xQueueSend(espNowQueue, &frame, 0) != pdTRUE) {
+    hubStats.espNowDrops = hubStats.espNowDrops + 1; // Never block WiFi task
+  } else if (netTaskHandle != NULL) {
+    xTaskNotifyGive(netTaskHandle); // Cut short an idle wait
+  }
+}
+
+// Drain and dispatch queued ESP-NOW frames. Payloads use the binary
+// protocol's opcode layout, so a sensor publish lands in the same
+// broker fan-out as a TCP publish. Returns bytes serviced.
+size_t serviceEspNow() {
+  EspNowFrame frame;
+  size_t serviced = 0;
+
+  while (espNowQueue != NULL && xQueueReceive(espNowQueue, &frame, 0) == pdTRUE) {
+    serviced += frame.len;
+    uint8_t op = frame.data[0];
+
+    if (op == OP_PUBLISH && frame.len >= 2 && frame.data[1] < MAX_TOPICS) {
+      publishToTopic(SLOT_ESPNOW, frame.data[1], frame.data, frame.len);
+      queueRxFrame(SLOT_ESPNOW, frame.data, frame.len);
+    } else if (op == OP_ECHO) {
+      // Echo back to the sender; register it as a peer on first contact
+      if (!esp_now_is_peer_exist(frame.mac)) {
+        esp_now_peer_info_t peer = {};
+        memcpy(peer.peer_addr, frame.mac, sizeof(frame.mac));
+        peer.channel = AP_CHANNEL;
+        peer.ifidx = WIFI_IF_AP;
+        esp_now_add_peer(&peer);
+      }
+      esp_now_send(frame.mac, frame.data, frame.len);
+    } else {
+      // Subscriptions need a return path; connectionless senders are
+      // publishers only
+      Serial.printf("ESP-NOW: unsupported opcode 0x%02X, frame dropped.\n", op);
+    }
+  }
+
+  return serviced;
+}
+
+// UART servicing task. Drains the serial TX ring against whatever the
+// UART driver's buffer will take right now (the driver feeds the FIFO
+// from interrupt context, so these writes return immediately), and in
+// bridge mode pulls incoming UART bytes into the RX ring for the
+// network task to fan out. Runs below the network task's priority.
+void uartTask(void *arg) {
+  uint8_t chunk[256];
+
+  for (;;) {
+    size_t worked = 0;
+
+    // TX: ring -> UART driver, limited to what fits without blocking
+    int writable = Serial.availableForWrite();
+    if (writable > 0) {
+      if (writable > (int)sizeof(chunk)) {
+        writable = sizeof(chunk);
+      }
+      taskENTER_CRITICAL(&serialTxMux);
+      uint16_t got = ringRead(serialTxRing, chunk, (uint16_t)writable);
+      taskEXIT_CRITICAL(&serialTxMux);
+      if (got > 0) {
+        Serial.write(chunk, got);
+        worked += got;
+      }
+    }
+
+#if UART_BRIDGE_MODE
+    // RX: UART -> ring, drained by the network task towards clients
+    size_t pending = Serial.available();
+    if (pending > 0) {
+      if (pending > sizeof(chunk)) {
+        pending = sizeof(chunk);
+      }
+      size_t got = Serial.readBytes(chunk, pending);
+      if (got > 0) {
+        taskENTER_CRITICAL(&serialRxMux);
+        ringWrite(serialRxRing, chunk, (uint16_t)got);
+        taskEXIT_CRITICAL(&serialRxMux);
+        worked += got;
+      }
+    }
+#endif
+
+    if (worked == 0) {
+#if UART_BRIDGE_MODE
+      // RX has no wakeup source, so idle passes still poll the driver
+      // once a tick — but a producer staging TX bytes cuts the wait
+      // short via the task notification
+      ulTaskNotifyTake(pdTRUE, 1);
+#else
+      // TX-only: sleep until a producer stages bytes. When the driver
+      // FIFO was full and the ring still holds data, retry next tick.
+      ulTaskNotifyTake(pdTRUE, serialTxRing.used > 0 ? 1 : portMAX_DELAY);
+#endif
+    }
+  }
+}
+
+#if UART_BRIDGE_MODE
+// Fan bytes that arrived on the UART out to every connected text-mode
+// client. Runs on the network task so all client TX rings stay
+// single-writer.
+size_t bridgeSerialToClients() {
+  uint8_t chunk[256];
+
+  taskENTER_CRITICAL(&serialRxMux);
+  uint16_t got = ringRead(serialRxRing, chunk, sizeof(chunk));
+  taskEXIT_CRITICAL(&serialRxMux);
+  if (got == 0) {
+    return 0;
+  }
+
+  for (int i = 0; i < MAX_CONNECTIONS; i++) {
+    if (clients[i] && clients[i].connected() && clientStates[i].mode == MODE_TEXT) {
+      clientSend(i, chunk, got);
+    }
+  }
+  return got;
+}
+#endif
+
+// Network servicing task. Runs the accept/relay loop forever, pinned to
+// NET_TASK_CORE so it never shares a core with WiFi/LwIP.
+void networkTask(void *arg) {
+  for (;;) {
+    uint32_t passStartUs = micros();
+
+    // Pull in any pending connection first so new stations are never
+    // starved by traffic on established ones
+    acceptClients();
+
+    // Round-robin over the pool: every ready socket gets serviced each
+    // pass, so no client can monopolize the task
+    size_t serviced = 0;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+      serviced += serviceClient(i);
+    }
+
+    // Bridge any frames that arrived over the ESP-NOW fast path
+    serviced += serviceEspNow();
+
+#if UART_BRIDGE_MODE
+    // Fan out anything that arrived on the UART
+    serviced += bridgeSerialToClients();
+#endif
+
+    uint32_t passUs = micros() - passStartUs;
+    statsRecordPass(passUs);
+#ifdef ENABLE_BENCHMARK
+    benchRecordPass(passUs);
+#endif
+
+    // Only back off when the pass moved no data; while traffic is
+    // flowing we go straight back to the sockets. Idle passes block on
+    // the task notification for up to a tick: sockets have no wakeup
+    // source and still get polled at tick rate, but an ESP-NOW frame
+    // wakes the task the moment it is queued instead of next tick.
+    if (serviced == 0) {
+      ulTaskNotifyTake(pdTRUE, 1);
+    }
+  }
+}
+
+void loop() {
+#if HP_BENCH_MODE
+  delay(1000); // Benchmark ran once from setup()
+  return;
+#endif
+
+  // The Arduino loop() task is the application-side consumer: it blocks
+  // on the frame queue and is woken the moment the network task hands
+  // something over. Today it just reports traffic; the relay itself
+  // happens entirely in the network task. The receive timeout bounds
+  // how long a pending serial command can wait.
+  RxFrame frame;
+  if (xQueueReceive(rxFrameQueue, &frame, pdMS_TO_TICKS(100)) == pdTRUE) {
+    Serial.printf("[app] %u bytes from slot %u\n", frame.len, frame.slot);
+  }
+
+#if !UART_BRIDGE_MODE
+  // 's' on the serial monitor dumps the full statistics snapshot.
+  // (In bridge mode serial input is payload, so no commands.)
+  while (Serial.available()) {
+    int c = Serial.read();
+    if (c == 's' || c == 'S') {
+      dumpStats();
+    }
+  }
+#endif
+}